@@ -1,36 +1,377 @@
 /* RoCC (Robust Congestion Control)
  */
 
+#include <linux/btf.h>
+#include <linux/btf_ids.h>
+#include <linux/cgroup.h>
+#include <linux/debugfs.h>
+#include <linux/filter.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/ratelimit.h>
+#include <linux/rcupdate.h>
+#include <linux/seq_file.h>
+#include <linux/timex.h>
+#include <linux/version.h>
+#include <linux/win_minmax.h>
+#include <net/ipv6.h>
 #include <net/tcp.h>
 
-#define ROCC_DEBUG
+#include "tcp_rocc_ccmatic.h"
+#include "tcp_rocc_rule.h"
 
-// Should be a power of two so rocc_num_intervals_mask can be set
-static const u16 rocc_num_intervals = 16;
-// rocc_num_intervals expressed as a mask. It is always equal to
-// rocc_num_intervals-1
-static const u16 rocc_num_intervals_mask = 15;
-static const u32 rocc_min_cwnd = 2;
-// Maximum tolerable loss rate, expressed as `loss_thresh / 1024`. Calculations
-// are faster if things are powers of 2
-static const u64 rocc_loss_thresh = 64;
-static const u32 rocc_alpha = 1;
+#define CREATE_TRACE_POINTS
+#include "tcp_rocc_trace.h"
 
-// To keep track of the number of packets acked over a short period of time
-struct rocc_interval {
-	// Starting time of this interval
-	u64 start_us;
-	u32 pkts_acked;
-	u32 pkts_lost;
-	bool app_limited;
+// When set, losses seen while RTT shows no queue build-up over the same
+// `hist_us` window are treated as random (non-congestive) and do not trigger a
+// multiplicative decrease
+static bool rocc_loss_classify __read_mostly = false;
+module_param(rocc_loss_classify, bool, 0644);
+MODULE_PARM_DESC(rocc_loss_classify, "Ignore losses that show no RTT increase (random loss)");
+// Queueing delay, expressed as `qdelay_thresh / 1024` of min_rtt, above which
+// losses are considered congestive
+static u32 rocc_loss_classify_qdelay __read_mostly = 128;
+module_param(rocc_loss_classify_qdelay, uint, 0644);
+MODULE_PARM_DESC(rocc_loss_classify_qdelay, "Queueing delay (x/1024 of min_rtt) that marks losses as congestive");
+// When set, losses later found to be spurious through DSACK are removed from the
+// history and the decrease they caused is reverted on undo
+static bool rocc_undo_spurious __read_mostly = true;
+module_param(rocc_undo_spurious, bool, 0644);
+MODULE_PARM_DESC(rocc_undo_spurious, "Discount losses undone by DSACK (reordering)");
+// When set, cwnd does not grow while TCP socket memory is (nearly) under
+// pressure, either globally or in the socket's memory cgroup
+static bool rocc_mem_pressure __read_mostly = true;
+module_param(rocc_mem_pressure, bool, 0644);
+MODULE_PARM_DESC(rocc_mem_pressure, "Stop cwnd growth under socket memory pressure");
+// Deadline-aware bias (see rocc_set_deadline). A flow whose required rate
+// exceeds its current pacing rate gets up to `rocc_deadline_max_boost` times
+// the additive increase; one that would need more than
+// `rocc_deadline_hopeless` times its current rate yields instead.
+static u32 rocc_deadline_max_boost __read_mostly = 4;
+module_param(rocc_deadline_max_boost, uint, 0644);
+MODULE_PARM_DESC(rocc_deadline_max_boost, "Max additive increase multiplier for flows near their deadline");
+static u32 rocc_deadline_hopeless __read_mostly = 16;
+module_param(rocc_deadline_hopeless, uint, 0644);
+MODULE_PARM_DESC(rocc_deadline_hopeless, "Required/current rate ratio above which a deadline flow yields");
+
+// Loss is judged on two horizons kept in the same history (see
+// rocc_window_loss_mode). A loss rate above `rocc_severe_loss_thresh / 1024`
+// over `rocc_short_hist_mult` min RTTs triggers a decrease right away (e.g.
+// link failover); milder loss must exceed rocc_loss_thresh over
+// `rocc_long_hist_mult` min RTTs, which is also the window of the increase
+// term.
+static u32 rocc_short_hist_mult __read_mostly = ROCC_SHORT_HIST_MULT;
+module_param(rocc_short_hist_mult, uint, 0644);
+MODULE_PARM_DESC(rocc_short_hist_mult, "Short loss horizon, in min RTTs");
+static u32 rocc_long_hist_mult __read_mostly = 3;
+module_param(rocc_long_hist_mult, uint, 0644);
+MODULE_PARM_DESC(rocc_long_hist_mult, "Long loss and increase horizon, in min RTTs");
+static u32 rocc_severe_loss_thresh __read_mostly = ROCC_SEVERE_LOSS_THRESH;
+module_param(rocc_severe_loss_thresh, uint, 0644);
+MODULE_PARM_DESC(rocc_severe_loss_thresh, "Short-horizon loss rate (x/1024) for an immediate decrease, 1024 = off");
+
+// With `rocc_loss_autotune`, each flow learns its background (non-congestive)
+// loss rate from the long-horizon history and uses
+// `rocc_loss_autotune_gain` times it as its loss threshold, kept within
+// [rocc_loss_thresh_min, rocc_loss_thresh_max] (x/1024). Otherwise the fixed
+// rocc_loss_thresh applies.
+static bool rocc_loss_autotune __read_mostly = false;
+module_param(rocc_loss_autotune, bool, 0644);
+MODULE_PARM_DESC(rocc_loss_autotune, "Set the loss threshold per flow from its background loss rate");
+static u32 rocc_loss_autotune_gain __read_mostly = 2;
+module_param(rocc_loss_autotune_gain, uint, 0644);
+MODULE_PARM_DESC(rocc_loss_autotune_gain, "Loss threshold as a multiple of the background loss rate");
+static u32 rocc_loss_thresh_min __read_mostly = 16;
+module_param(rocc_loss_thresh_min, uint, 0644);
+MODULE_PARM_DESC(rocc_loss_thresh_min, "Lowest auto-tuned loss threshold (x/1024)");
+static u32 rocc_loss_thresh_max __read_mostly = 256;
+module_param(rocc_loss_thresh_max, uint, 0644);
+MODULE_PARM_DESC(rocc_loss_thresh_max, "Highest auto-tuned loss threshold (x/1024)");
+
+// A/B experiments: with `rocc_ab_arms` > 0, each new socket is assigned to
+// one of that many arms by a hash of its 4-tuple (`rocc_ab_key` 0) or at random
+// (1), salted with `rocc_ab_seed`. Arm i overrides the long-horizon loss
+// threshold, alpha and long history multiplier with the i-th entry of
+// rocc_ab_loss_thresh, rocc_ab_alpha and rocc_ab_hist_mult, where non-zero.
+// Per-arm metrics are in debugfs `ab`.
+#define ROCC_AB_MAX_ARMS 4
+#define ROCC_AB_NONE 0xff
+static u32 rocc_ab_arms __read_mostly = 0;
+module_param(rocc_ab_arms, uint, 0644);
+MODULE_PARM_DESC(rocc_ab_arms, "Number of A/B experiment arms (max 4), 0 = off");
+static u32 rocc_ab_key __read_mostly = 0;
+module_param(rocc_ab_key, uint, 0644);
+MODULE_PARM_DESC(rocc_ab_key, "Arm assignment: 0 = hash of the 4-tuple, 1 = random");
+static u32 rocc_ab_seed __read_mostly = 0;
+module_param(rocc_ab_seed, uint, 0644);
+MODULE_PARM_DESC(rocc_ab_seed, "Salt of the arm assignment hash");
+static u32 rocc_ab_loss_thresh[ROCC_AB_MAX_ARMS];
+module_param_array(rocc_ab_loss_thresh, uint, NULL, 0644);
+MODULE_PARM_DESC(rocc_ab_loss_thresh, "Per-arm loss threshold (x/1024), 0 = default");
+static u32 rocc_ab_alpha[ROCC_AB_MAX_ARMS];
+module_param_array(rocc_ab_alpha, uint, NULL, 0644);
+MODULE_PARM_DESC(rocc_ab_alpha, "Per-arm alpha, 0 = default");
+static u32 rocc_ab_hist_mult[ROCC_AB_MAX_ARMS];
+module_param_array(rocc_ab_hist_mult, uint, NULL, 0644);
+MODULE_PARM_DESC(rocc_ab_hist_mult, "Per-arm long history multiplier, 0 = default");
+
+// Time one in `rocc_prof_every` calls of rocc_process_sample with the cycle
+// counter, into per-CPU histograms by code path (debugfs `profile`). 0 = off.
+static u32 rocc_prof_every __read_mostly = 0;
+module_param(rocc_prof_every, uint, 0644);
+MODULE_PARM_DESC(rocc_prof_every, "Profile one in N ACKs, 0 = off");
+
+// Count, and trace (tcp_rocc:rocc_pathology), flows that stay at the minimum
+// cwnd, oscillate by more than 2x per round, or pace at more than
+// `rocc_patho_rate_ratio` times (or less than 1/that of) their delivery
+// rate, each for `rocc_patho_rounds` consecutive min RTTs; and decreases less
+// than a min RTT apart. Counts are in debugfs `pathologies`.
+static bool rocc_patho_detect __read_mostly = true;
+module_param(rocc_patho_detect, bool, 0644);
+MODULE_PARM_DESC(rocc_patho_detect, "Detect and count pathological flow behaviour");
+static u32 rocc_patho_rounds __read_mostly = 16;
+module_param(rocc_patho_rounds, uint, 0644);
+MODULE_PARM_DESC(rocc_patho_rounds, "Consecutive min RTTs a pathology must last to be reported");
+static u32 rocc_patho_rate_ratio __read_mostly = 4;
+module_param(rocc_patho_rate_ratio, uint, 0644);
+MODULE_PARM_DESC(rocc_patho_rate_ratio, "Pacing/delivery rate ratio (either way) counted as a mismatch");
+
+// Connections to this host (over loopback) have no bottleneck worth
+// controlling. With `rocc_local_fastpath`, they skip the history, loss test
+// and pacing, and run at a fixed cwnd of `rocc_local_cwnd`.
+static bool rocc_local_fastpath __read_mostly = true;
+module_param(rocc_local_fastpath, bool, 0644);
+MODULE_PARM_DESC(rocc_local_fastpath, "Fixed cwnd and no pacing for connections over loopback");
+static u32 rocc_local_cwnd __read_mostly = 1024;
+module_param(rocc_local_cwnd, uint, 0644);
+MODULE_PARM_DESC(rocc_local_cwnd, "cwnd of loopback connections under rocc_local_fastpath");
+
+// When no ACK has arrived for `rocc_starve_rtts` min RTTs (reverse path
+// congestion or ACK loss), the delivery rate and min RTT behind the pacing rate
+// are stale. Halve the pacing rate once per such gap, at most
+// `rocc_starve_max_shift` times. 0 turns this off.
+static u32 rocc_starve_rtts __read_mostly = 4;
+module_param(rocc_starve_rtts, uint, 0644);
+MODULE_PARM_DESC(rocc_starve_rtts, "ACK gap, in min RTTs, after which the pacing rate decays, 0 = off");
+static u32 rocc_starve_max_shift __read_mostly = 4;
+module_param(rocc_starve_max_shift, uint, 0644);
+MODULE_PARM_DESC(rocc_starve_max_shift, "Max number of pacing rate halvings on an ACK gap");
+
+// Optional cap on cwnd at `rocc_bdp_cap_gain / 1024` times the estimated BDP
+// (windowed max delivery rate x min RTT), to bound queueing on deep buffers.
+// 0 disables the cap. The max filter spans `rocc_bdp_cap_win` min RTTs.
+static u32 rocc_bdp_cap_gain __read_mostly = 0;
+module_param(rocc_bdp_cap_gain, uint, 0644);
+MODULE_PARM_DESC(rocc_bdp_cap_gain, "Cap cwnd at x/1024 of estimated BDP, 0 = off");
+static u32 rocc_bdp_cap_win __read_mostly = 10;
+module_param(rocc_bdp_cap_win, uint, 0644);
+MODULE_PARM_DESC(rocc_bdp_cap_win, "Delivery rate max filter window, in min RTTs");
+
+// Host-wide egress budget shared by all RoCC flows, in Mbit/s. 0 = off. When
+// the flows' combined pacing rate exceeds it, each flow is scaled down in
+// proportion to its own rate.
+static u32 rocc_host_budget_mbps __read_mostly = 0;
+module_param(rocc_host_budget_mbps, uint, 0644);
+MODULE_PARM_DESC(rocc_host_budget_mbps, "Aggregate pacing rate budget for all RoCC flows (Mbit/s), 0 = off");
+
+// Sum of the uncapped pacing rates of all flows, in KiB/s. Flows add their
+// changes to the counter of the CPU they run on, so individual counters may
+// go negative; only the sum is meaningful. It is aggregated into
+// rocc_host_rate at most once per jiffy, by whichever flow notices first.
+static DEFINE_PER_CPU(s64, rocc_host_rate_pcpu);
+static atomic64_t rocc_host_rate = ATOMIC64_INIT(0);
+static unsigned long rocc_host_rate_stamp;
+
+// Background loss rates are kept as x/1024 << ROCC_LOSS_BG_SHIFT
+#define ROCC_LOSS_BG_SHIFT 4
+// Fewest packets in the long window for it to update the background loss rate
+#define ROCC_LOSS_BG_MIN_PKTS 32
+
+// Histogram of the auto-tuned loss thresholds in use, sampled once per
+// history interval of each flow. Bucket i counts thresholds in
+// [16 * i, 16 * i + 15]; the last bucket also counts everything above.
+#define ROCC_THRESH_BUCKETS 17
+struct rocc_thresh_stats {
+	u64 hist[ROCC_THRESH_BUCKETS];
+};
+static DEFINE_PER_CPU(struct rocc_thresh_stats, rocc_thresh_stats);
+
+// Aggregate metrics of the sockets in one A/B arm
+struct rocc_arm_stats {
+	u64 flows;
+	u64 delivered_bytes;
+	u64 lost_pkts;
+	u64 decreases;
+	// Number of ACKs and sum of cwnd after each, for the mean cwnd
+	u64 acks;
+	u64 cwnd_sum;
+	// Time spent at the flow's min cwnd
+	u64 min_cwnd_us;
+};
+struct rocc_ab_stats {
+	struct rocc_arm_stats arm[ROCC_AB_MAX_ARMS];
+};
+static DEFINE_PER_CPU(struct rocc_ab_stats, rocc_ab_stats);
+
+/* Per-service tuning. Operators define up to ROCC_MAX_PROFILES - 1 profiles
+ * and rules that map a socket's cgroup, destination port or destination prefix
+ * to one of them, through debugfs `policy` (see rocc_policy_write). A socket
+ * picks its profile at rocc_init: cgroup rules first, then port, then the
+ * longest matching prefix.
+ */
+#define ROCC_MAX_PROFILES 16
+#define ROCC_POLICY_HASH_BITS 6
+#define ROCC_POLICY_MAX_RULES 4096
+
+// Parameters a flow runs with. In a profile, 0 leaves the module default.
+struct rocc_profile {
+	// Long-horizon loss threshold, x/1024
+	u32 loss_thresh;
+	u32 alpha;
+	// Long history, in min RTTs
+	u32 hist_mult;
+	// Pacing rate multiplier, x/1024
+	u32 pacing_gain;
+	u32 min_cwnd;
+};
+
+// Profile 0 means "no profile". Fields are read without locking; a socket
+// may briefly see a profile that is half updated, which is harmless.
+static struct rocc_profile rocc_profiles[ROCC_MAX_PROFILES];
+
+enum rocc_rule_kind {
+	ROCC_RULE_CGROUP,
+	ROCC_RULE_PORT,
+	ROCC_RULE_PREFIX,
+};
+
+struct rocc_rule {
+	struct hlist_node node;
+	enum rocc_rule_kind kind;
+	// cgroup id or destination port
+	u64 key;
+	// Destination prefix, IPv4-mapped for IPv4, and its length
+	struct in6_addr prefix;
+	u8 len;
+	u8 profile;
+};
+
+// An immutable rule set, replaced as a whole under RCU
+struct rocc_policy {
+	struct rcu_head rcu;
+	DECLARE_HASHTABLE(cgroups, ROCC_POLICY_HASH_BITS);
+	DECLARE_HASHTABLE(ports, ROCC_POLICY_HASH_BITS);
+	DECLARE_HASHTABLE(prefixes, ROCC_POLICY_HASH_BITS);
+	// Prefix lengths that have at least one rule, longest first
+	u8 prefix_lens[129];
+	u8 num_prefix_lens;
+	u32 num_rules;
+	struct rocc_rule rules[];
 };
 
+static struct rocc_policy __rcu *rocc_policy;
+static DEFINE_MUTEX(rocc_policy_mutex);
+
+/* Code path taken by one rocc_process_sample call, as flags. The profiler
+ * keeps a histogram per combination.
+ */
+#define ROCC_PATH_PUSH		1	// started a new history interval
+#define ROCC_PATH_DECREASE	2	// multiplicative decrease
+#define ROCC_PATH_APP_LIMITED	4	// window mostly app-limited
+#define ROCC_NUM_PATHS		8
+// Log2 buckets of cycles: bucket i counts [2^i, 2^(i+1))
+#define ROCC_PROF_BUCKETS	32
+
+struct rocc_prof_stats {
+	u64 hist[ROCC_NUM_PATHS][ROCC_PROF_BUCKETS];
+};
+static DEFINE_PER_CPU(struct rocc_prof_stats, rocc_prof_stats);
+static DEFINE_PER_CPU(u32, rocc_prof_tick);
+
+// enum rocc_pathology is in tcp_rocc_trace.h
+static const char * const rocc_patho_names[ROCC_NUM_PATHOLOGIES] = {
+	"min_cwnd", "oscillation", "rate_mismatch", "repeat_decrease",
+};
+
+// Pathology detector state of one flow. It does not fit in inet_csk_ca(),
+// so it is allocated right after the flow's intervals (see rocc_patho()).
+struct rocc_patho {
+	// Current round (one min RTT): start and cwnd range
+	u32 round_start_us;
+	u32 round_min_cwnd;
+	u32 round_max_cwnd;
+	// Consecutive rounds showing each pathology
+	u16 min_cwnd_rounds;
+	u16 osc_rounds;
+	u16 rate_rounds;
+	// Time of the last decrease, 0 if none
+	u32 last_decrease_us;
+};
+
+struct rocc_patho_stats {
+	u64 count[ROCC_NUM_PATHOLOGIES];
+};
+static DEFINE_PER_CPU(struct rocc_patho_stats, rocc_patho_stats);
+// Shared by all flows: at most 10 pathology tracepoints per second
+static DEFINE_RATELIMIT_STATE(rocc_patho_ratelimit, HZ, 10);
+
+// How long state written to debugfs `restore` waits for its socket
+#define ROCC_RESTORE_TIMEOUT (60 * HZ)
+// Largest write to debugfs `restore`, in bytes
+#define ROCC_RESTORE_MAX_WRITE (64 << 10)
+
+// Delivery rate is kept in packets per usec << BW_SCALE, as in BBR
+#define BW_SCALE 24
+#define BW_UNIT (1 << BW_SCALE)
+
+// Coupled congestion control across the subflows of one MPTCP connection (or
+// any other set of sockets joined with rocc_couple). Members of a group share
+// one additive increase, split in proportion to their cwnds.
+
+// Sockets whose congestion control is coupled
+struct rocc_group {
+	struct hlist_node node;
+	u32 key;
+	refcount_t refcnt;
+	// Sum of the cwnds of all members, in packets
+	atomic_long_t total_cwnd;
+};
+
+#define ROCC_GROUP_HASH_BITS 8
+static DEFINE_HASHTABLE(rocc_groups, ROCC_GROUP_HASH_BITS);
+static DEFINE_SPINLOCK(rocc_groups_lock);
+
+// State saved from a socket before TCP_REPAIR migration, applied to the
+// socket with the same 4-tuple when it is repaired (see rocc_restore_write)
+struct rocc_saved_state {
+	struct list_head list;
+	unsigned long expires;
+	// Addresses are stored IPv4-mapped for AF_INET
+	struct in6_addr saddr, daddr;
+	__be16 sport, dport;
+	u32 min_rtt_us;
+	u32 cwnd;
+	// Delivery rate, in bytes per second
+	u64 bw;
+};
+
+static LIST_HEAD(rocc_saved_states);
+static DEFINE_SPINLOCK(rocc_saved_states_lock);
+static struct dentry *rocc_debugfs_dir;
+
 static u32 id = 0;
 struct rocc_data {
 	// Circular queue of intervals
 	struct rocc_interval *intervals;
 	// Index of the last interval to be added
 	u16 intervals_head;
+	// Peer is on this host; see rocc_local_fastpath. intervals is NULL.
+	u8 local;
+	// A/B experiment arm, or ROCC_AB_NONE
+	u8 arm;
 
 	u32 min_rtt_us;
 
@@ -38,21 +379,292 @@ struct rocc_data {
 	u32 id;
 
 	u32 last_decrease_seq;
+	// cwnd just before the last decrease, restored if the losses that
+	// caused it turn out to be spurious. 0 if there is nothing to undo.
+	u32 prior_cwnd;
+	// tsk->dsack_dups when the last sample was processed
+	u32 last_dsack_dups;
+
+	// Completion deadline (tcp_clock_us() time) and bytes still to be
+	// delivered before it. deadline_us is 0 if the flow has no deadline.
+	u64 deadline_us;
+	u64 remaining_bytes;
+
+	// Coupling group this socket belongs to, or NULL
+	struct rocc_group *group;
+	// cwnd this socket currently contributes to group->total_cwnd
+	u32 group_cwnd;
+	// Fractional part of the coupled additive increase, in 1/1024 packets
+	u32 alpha_frac;
+
+	// Windowed max delivery rate, in packets per usec << BW_SCALE
+	struct minmax bw;
+
+	// Pacing rate this flow currently adds to rocc_host_rate, in KiB/s
+	u32 host_rate;
+
+	// Low 32 bits of tcp_mstamp at the last ACK
+	u32 last_ack_us;
+
+	// Background loss rate, see rocc_loss_autotune
+	u16 loss_bg;
+	// Index in rocc_profiles, 0 if none
+	u8 profile;
+	// ROCC_F_*
+	u8 flags;
 };
 
+// A TLP retransmission was outstanding at the last sample
+#define ROCC_F_TLP_RETRANS 0x1
+
+static void rocc_init(struct sock *sk);
+
+static void rocc_leave_group(struct rocc_data *rocc)
+{
+	struct rocc_group *group = rocc->group;
+
+	if (!group)
+		return;
+	atomic_long_sub(rocc->group_cwnd, &group->total_cwnd);
+	rocc->group = NULL;
+	rocc->group_cwnd = 0;
+	if (refcount_dec_and_test(&group->refcnt)) {
+		// Lookups only take groups with a non-zero refcount under the
+		// lock, so nobody can be using it once it is unhashed
+		spin_lock_bh(&rocc_groups_lock);
+		hash_del(&group->node);
+		spin_unlock_bh(&rocc_groups_lock);
+		kfree(group);
+	}
+}
+
+/* Couple `sk` with all other RoCC sockets that joined with the same `key`, e.g.
+ * the subflows of one MPTCP connection. The group's aggregate additive
+ * increase matches that of a single flow, and is shifted towards the members
+ * with the largest cwnd, i.e. the least congested paths. Returns 0 or -errno.
+ */
+int rocc_couple(struct sock *sk, u32 key)
+{
+	struct rocc_data *rocc = inet_csk_ca(sk);
+	struct rocc_group *group, *new_group;
+
+	if (inet_csk(sk)->icsk_ca_ops->init != rocc_init)
+		return -EINVAL;
+
+	new_group = kzalloc(sizeof(*new_group), GFP_ATOMIC);
+	if (!new_group)
+		return -ENOMEM;
+
+	rocc_leave_group(rocc);
+	spin_lock_bh(&rocc_groups_lock);
+	hash_for_each_possible(rocc_groups, group, node, key) {
+		if (group->key == key && refcount_inc_not_zero(&group->refcnt))
+			break;
+	}
+	if (!group) {
+		group = new_group;
+		new_group = NULL;
+		group->key = key;
+		refcount_set(&group->refcnt, 1);
+		atomic_long_set(&group->total_cwnd, 0);
+		hash_add(rocc_groups, &group->node, key);
+	}
+	spin_unlock_bh(&rocc_groups_lock);
+	kfree(new_group);
+
+	rocc->group = group;
+	rocc->group_cwnd = tcp_sk(sk)->snd_cwnd;
+	atomic_long_add(rocc->group_cwnd, &group->total_cwnd);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(rocc_couple);
+
+// Share of the group's additive increase that goes to this socket:
+// alpha * cwnd / total_cwnd, with the fraction carried over between ACKs.
+static u32 rocc_coupled_alpha(struct rocc_data *rocc, u32 alpha, u32 cwnd)
+{
+	long total = atomic_long_read(&rocc->group->total_cwnd);
+
+	if (total <= cwnd)
+		return alpha;
+	rocc->alpha_frac += div_u64((u64) alpha * cwnd * 1024, total);
+	alpha = rocc->alpha_frac >> 10;
+	rocc->alpha_frac &= 1023;
+	return alpha;
+}
+
+static u32 rocc_get_mss(struct tcp_sock *tsk)
+{
+	// TODO: Figure out if mss_cache is the one to use
+	return tsk->mss_cache;
+}
+
+static void rocc_sk_addrs(const struct sock *sk, struct in6_addr *saddr,
+			  struct in6_addr *daddr)
+{
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6) {
+		*saddr = sk->sk_v6_rcv_saddr;
+		*daddr = sk->sk_v6_daddr;
+		return;
+	}
+#endif
+	ipv6_addr_set_v4mapped(inet_sk(sk)->inet_saddr, saddr);
+	ipv6_addr_set_v4mapped(inet_sk(sk)->inet_daddr, daddr);
+}
+
+// Take the saved state for this socket's 4-tuple, if any. Also drops expired
+// entries. The caller frees the result.
+static struct rocc_saved_state *rocc_take_saved_state(const struct sock *sk)
+{
+	struct rocc_saved_state *s, *tmp, *found = NULL;
+	struct in6_addr saddr, daddr;
+
+	if (list_empty(&rocc_saved_states))
+		return NULL;
+	rocc_sk_addrs(sk, &saddr, &daddr);
+	spin_lock_bh(&rocc_saved_states_lock);
+	list_for_each_entry_safe(s, tmp, &rocc_saved_states, list) {
+		if (!found && s->sport == inet_sk(sk)->inet_sport &&
+		    s->dport == inet_sk(sk)->inet_dport &&
+		    ipv6_addr_equal(&s->saddr, &saddr) &&
+		    ipv6_addr_equal(&s->daddr, &daddr)) {
+			list_del(&s->list);
+			found = s;
+		} else if (time_after(jiffies, s->expires)) {
+			list_del(&s->list);
+			kfree(s);
+		}
+	}
+	spin_unlock_bh(&rocc_saved_states_lock);
+	return found;
+}
+
+// Resume a migrated connection where it left off: min RTT, cwnd, delivery
+// rate, and one interval of history worth a full window, so that the next
+// ACK does not halve cwnd towards an empty history
+static void rocc_restore(struct sock *sk, struct rocc_data *rocc)
+{
+	struct tcp_sock *tsk = tcp_sk(sk);
+	struct rocc_saved_state *s = rocc_take_saved_state(sk);
+	u32 mss = max(rocc_get_mss(tsk), 1U);
+
+	if (!s)
+		return;
+	rocc->min_rtt_us = max(s->min_rtt_us, 1U);
+	tsk->snd_cwnd = max(s->cwnd, rocc_min_cwnd);
+	minmax_reset(&rocc->bw, (u32) tcp_clock_us(),
+		     (u32) min_t(u64, div64_u64(s->bw * BW_UNIT, (u64) mss * USEC_PER_SEC),
+				 U32_MAX));
+	if (rocc->intervals) {
+		rocc->intervals[rocc->intervals_head].start_us = tcp_clock_us();
+		rocc->intervals[rocc->intervals_head].pkts_acked = tsk->snd_cwnd;
+	}
+	sk->sk_pacing_rate = rocc_pacing_rate(tsk->snd_cwnd, mss, rocc->min_rtt_us);
+	kfree(s);
+}
+
+// Is the connection routed over loopback, i.e. to this host?
+static bool rocc_is_local(struct sock *sk)
+{
+	struct dst_entry *dst = __sk_dst_get(sk);
+
+	return dst && dst->dev && (dst->dev->flags & IFF_LOOPBACK);
+}
+
+static void rocc_local_set_cwnd(struct tcp_sock *tsk)
+{
+	tsk->snd_cwnd = min(max(rocc_local_cwnd, rocc_min_cwnd), tsk->snd_cwnd_clamp);
+}
+
+static u32 rocc_prefix_hash(const struct in6_addr *prefix, u8 len)
+{
+	return jhash2((const u32 *) prefix, 4, len);
+}
+
+// Profile for a new socket from rocc_policy, 0 if no rule matches
+static u8 rocc_policy_lookup(const struct sock *sk)
+{
+	struct rocc_policy *policy;
+	struct rocc_rule *rule;
+	struct in6_addr saddr, daddr, prefix;
+	u64 key;
+	u8 profile = 0, len;
+	int i;
+
+	rcu_read_lock();
+	policy = rcu_dereference(rocc_policy);
+	if (!policy)
+		goto out;
+#ifdef CONFIG_SOCK_CGROUP_DATA
+	key = cgroup_id(sock_cgroup_ptr(&sk->sk_cgrp_data));
+	hash_for_each_possible_rcu(policy->cgroups, rule, node, key) {
+		if (rule->key == key) {
+			profile = rule->profile;
+			goto out;
+		}
+	}
+#endif
+	key = ntohs(inet_sk(sk)->inet_dport);
+	hash_for_each_possible_rcu(policy->ports, rule, node, key) {
+		if (rule->key == key) {
+			profile = rule->profile;
+			goto out;
+		}
+	}
+	// One hash lookup per prefix length in use, longest first
+	rocc_sk_addrs(sk, &saddr, &daddr);
+	for (i = 0; i < policy->num_prefix_lens; ++i) {
+		len = policy->prefix_lens[i];
+		ipv6_addr_prefix(&prefix, &daddr, len);
+		hash_for_each_possible_rcu(policy->prefixes, rule, node,
+					   rocc_prefix_hash(&prefix, len)) {
+			if (rule->len == len && ipv6_addr_equal(&rule->prefix, &prefix)) {
+				profile = rule->profile;
+				goto out;
+			}
+		}
+	}
+out:
+	rcu_read_unlock();
+	return profile;
+}
+
+// A/B arm for a new socket
+static u8 rocc_ab_assign(const struct sock *sk)
+{
+	struct {
+		struct in6_addr saddr, daddr;
+		__be16 sport, dport;
+	} key;
+	u32 arms = min_t(u32, rocc_ab_arms, ROCC_AB_MAX_ARMS);
+	u32 hash;
+
+	if (rocc_ab_key == 1) {
+		hash = get_random_u32();
+	} else {
+		rocc_sk_addrs(sk, &key.saddr, &key.daddr);
+		key.sport = inet_sk(sk)->inet_sport;
+		key.dport = inet_sk(sk)->inet_dport;
+		hash = jhash2((u32 *) &key, sizeof(key) / sizeof(u32), rocc_ab_seed);
+	}
+	return (u8) reciprocal_scale(hash, arms);
+}
+
 static void rocc_init(struct sock *sk)
 {
 	struct rocc_data *rocc = inet_csk_ca(sk);
-	u16 i;
 
-	rocc->intervals = kzalloc(sizeof(struct rocc_interval) * rocc_num_intervals,
-				  GFP_KERNEL);
-	for (i = 0; i < rocc_num_intervals; ++i) {
-		rocc->intervals[i].start_us = 0;
-		rocc->intervals[i].pkts_acked = 0;
-		rocc->intervals[i].pkts_lost = 0;
-		rocc->intervals[i].app_limited = false;
+	rocc->arm = ROCC_AB_NONE;
+	rocc->profile = 0;
+	rocc->local = rocc_local_fastpath && rocc_is_local(sk);
+	rocc->intervals = NULL;
+	if (!rocc->local) {
+		rocc->intervals = kzalloc(sizeof(struct rocc_interval) * rocc_num_intervals +
+					  sizeof(struct rocc_patho), GFP_KERNEL);
 	}
+	if (rocc->intervals)
+		rocc_hist_reset(rocc->intervals, rocc_num_intervals_mask);
 	rocc->intervals_head = 0;
 
 	rocc->min_rtt_us = U32_MAX;
@@ -61,14 +673,46 @@ static void rocc_init(struct sock *sk)
 	// At connection setup, assume just decreased.
 	// We don't expect loss during initial part of slow start anyway.
 	rocc->last_decrease_seq = tcp_sk(sk)->snd_nxt;
+	rocc->prior_cwnd = 0;
+	rocc->last_dsack_dups = tcp_sk(sk)->dsack_dups;
+	rocc->flags = 0;
+	rocc->deadline_us = 0;
+	rocc->remaining_bytes = 0;
+	rocc->group = NULL;
+	rocc->group_cwnd = 0;
+	rocc->alpha_frac = 0;
+	minmax_reset(&rocc->bw, 0, 0);
+	rocc->host_rate = 0;
+	rocc->last_ack_us = (u32) tcp_clock_us();
+	// Start out at the fixed threshold
+	rocc->loss_bg = min_t(u64, (rocc_loss_thresh << ROCC_LOSS_BG_SHIFT) /
+			      max(rocc_loss_autotune_gain, 1U), U16_MAX);
+	if (rocc->local) {
+		rocc_local_set_cwnd(tcp_sk(sk));
+		sk->sk_pacing_rate = ~0UL;
+		return;
+	}
+	rocc->profile = rocc_policy_lookup(sk);
+	if (rocc_ab_arms) {
+		rocc->arm = rocc_ab_assign(sk);
+		this_cpu_inc(rocc_ab_stats.arm[rocc->arm].flows);
+	}
+	// Sockets restored with TCP_REPAIR pick up state saved before migration
+	if (tcp_sk(sk)->repair)
+		rocc_restore(sk, rocc);
 
 	cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
 }
 
-static u32 rocc_get_mss(struct tcp_sock *tsk)
+static struct rocc_patho *rocc_patho(struct rocc_data *rocc)
 {
-	// TODO: Figure out if mss_cache is the one to use
-	return tsk->mss_cache;
+	return (struct rocc_patho *) (rocc->intervals + rocc_num_intervals);
+}
+
+// Delivery rate in bytes per second, from the windowed max filter
+static u64 rocc_bw_bytes(struct rocc_data *rocc, struct tcp_sock *tsk)
+{
+	return (u64) minmax_get(&rocc->bw) * rocc_get_mss(tsk) * USEC_PER_SEC >> BW_SCALE;
 }
 
 /* was the rocc struct fully inited */
@@ -77,27 +721,424 @@ static bool rocc_valid(struct rocc_data *rocc)
 	return (rocc && rocc->intervals);
 }
 
-static void rocc_process_sample(struct sock *sk, const struct rate_sample *rs)
+// Is socket memory under pressure, or about to be? We stop growing slightly
+// before tcp_mem[1] so that the stack does not have to collapse and prune
+// our queues.
+static bool rocc_under_mem_pressure(const struct sock *sk)
+{
+	if (tcp_under_memory_pressure(sk))
+		return true;
+	return sk_memory_allocated(sk) * 8 >= sk_prot_mem_limits(sk, 1) * 7;
+}
+
+/* Give a RoCC socket a completion target: `remaining_bytes` should be
+ * delivered within `budget_us` from now. For other kernel modules that know
+ * the application's deadline; sockops programs use bpf_rocc_set_deadline().
+ * A zero budget clears the hint.
+ */
+void rocc_set_deadline(struct sock *sk, u32 budget_us, u64 remaining_bytes)
+{
+	struct rocc_data *rocc = inet_csk_ca(sk);
+
+	if (inet_csk(sk)->icsk_ca_ops->init != rocc_init)
+		return;
+	rocc->deadline_us = budget_us ? tcp_clock_us() + budget_us : 0;
+	rocc->remaining_bytes = remaining_bytes;
+}
+EXPORT_SYMBOL_GPL(rocc_set_deadline);
+
+// Module kfuncs callable from sockops programs need the SOCK_OPS kfunc hook
+// (Linux 6.15) and the BTF_KFUNCS_START/__bpf_kfunc_start_defs macros
+#if IS_ENABLED(CONFIG_BPF_SYSCALL) && LINUX_VERSION_CODE >= KERNEL_VERSION(6, 15, 0)
+#define ROCC_HAVE_KFUNCS
+#endif
+
+#ifdef ROCC_HAVE_KFUNCS
+/* The same from a BPF_PROG_TYPE_SOCK_OPS program, which passes its context
+ * through bpf_cast_to_kern_ctx(). The deadline counts from this call, and
+ * rocc_init() clears it, so call it once the connection is established and
+ * after the first ACK, e.g. from BPF_SOCK_OPS_RTT_CB (see
+ * test/deadline_sockops.bpf.c). Returns -EOPNOTSUPP for non-RoCC sockets.
+ */
+static int rocc_kfunc_check(struct sock *sk)
+{
+	if (!sk || !sk_fullsock(sk) || sk->sk_protocol != IPPROTO_TCP)
+		return -EINVAL;
+	if (inet_csk(sk)->icsk_ca_ops->init != rocc_init)
+		return -EOPNOTSUPP;
+	return 0;
+}
+
+__bpf_kfunc_start_defs();
+
+__bpf_kfunc int bpf_rocc_set_deadline(struct bpf_sock_ops_kern *skops, u32 budget_us,
+				      u64 remaining_bytes)
+{
+	int ret = rocc_kfunc_check(skops->sk);
+
+	if (ret)
+		return ret;
+	rocc_set_deadline(skops->sk, budget_us, remaining_bytes);
+	return 0;
+}
+
+/* rocc_couple() for sockops programs. For the subflows of an MPTCP connection
+ * pass the connection's token, which bpf_skc_to_mptcp_sock() gives access to
+ * (see test/mptcp_couple_sockops.bpf.c).
+ */
+__bpf_kfunc int bpf_rocc_couple(struct bpf_sock_ops_kern *skops, u32 key)
+{
+	int ret = rocc_kfunc_check(skops->sk);
+
+	if (ret)
+		return ret;
+	return rocc_couple(skops->sk, key);
+}
+
+__bpf_kfunc_end_defs();
+
+BTF_KFUNCS_START(rocc_kfunc_ids)
+BTF_ID_FLAGS(func, bpf_rocc_set_deadline)
+BTF_ID_FLAGS(func, bpf_rocc_couple)
+BTF_KFUNCS_END(rocc_kfunc_ids)
+
+static const struct btf_kfunc_id_set rocc_kfunc_set = {
+	.owner = THIS_MODULE,
+	.set = &rocc_kfunc_ids,
+};
+#endif
+
+// Additive increase and decrease terms for this flow. Flows that will miss
+// their deadline at the current rate increase faster and do not subtract
+// alpha on decrease; flows that cannot make it anymore stop increasing and
+// back off harder so that others can.
+static void rocc_deadline_alpha(struct sock *sk, struct rocc_data *rocc,
+				u64 now_us, u32 alpha, u32 *inc, u32 *dec)
+{
+	u64 required, current_rate;
+	u32 boost;
+
+	*inc = alpha;
+	*dec = alpha;
+	if (!rocc->deadline_us || !rocc->remaining_bytes)
+		return;
+
+	// tcp_clock_us() is a u64 and does not wrap
+	if (rocc->deadline_us <= now_us) {
+		*inc = 0;
+		*dec = 2 * alpha;
+		return;
+	}
+	// Bytes per second needed to finish in time
+	required = div64_u64(rocc->remaining_bytes * USEC_PER_SEC,
+			     rocc->deadline_us - now_us);
+	current_rate = max_t(u64, sk->sk_pacing_rate, 1);
+	if (required > current_rate * rocc_deadline_hopeless) {
+		*inc = 0;
+		*dec = 2 * alpha;
+	} else if (required > current_rate) {
+		boost = min_t(u64, div64_u64(required, current_rate) + 1,
+			      rocc_deadline_max_boost);
+		*inc = boost * alpha;
+		*dec = 0;
+	}
+}
+
+// Track the max delivery rate over the last `rocc_bdp_cap_win` min RTTs.
+// App-limited samples only count if they raise the estimate.
+static void rocc_update_bw(struct rocc_data *rocc, const struct rate_sample *rs,
+			   u64 now_us)
+{
+	u64 bw;
+	u32 win;
+
+	if (rs->interval_us <= 0 || rocc->min_rtt_us == U32_MAX)
+		return;
+	bw = div64_long((u64) rs->delivered * BW_UNIT, rs->interval_us);
+	if (rs->is_app_limited && bw < minmax_get(&rocc->bw))
+		return;
+	win = rocc_horizon_us(rocc->min_rtt_us, rocc_bdp_cap_win);
+	minmax_running_max(&rocc->bw, win, (u32) now_us, (u32) min_t(u64, bw, U32_MAX));
+}
+
+// Largest cwnd allowed by the BDP cap, or U32_MAX if there is no estimate
+static u32 rocc_bdp_cap(struct rocc_data *rocc)
+{
+	u64 bdp = (u64) minmax_get(&rocc->bw) * rocc->min_rtt_us;
+
+	if (!bdp || rocc->min_rtt_us == U32_MAX)
+		return U32_MAX;
+	return (u32) min_t(u64, (bdp * rocc_bdp_cap_gain / 1024) >> BW_SCALE, U32_MAX);
+}
+
+// Take this flow's pacing rate out of the host-wide sum
+static void rocc_host_withdraw(struct rocc_data *rocc)
+{
+	this_cpu_sub(rocc_host_rate_pcpu, rocc->host_rate);
+	rocc->host_rate = 0;
+}
+
+// Record this flow's uncapped pacing rate in the host-wide sum and return its
+// share of the budget. Lock-free: a per-CPU add on every call, and a sum over
+// all CPUs once per jiffy.
+static u64 rocc_host_budget_share(struct rocc_data *rocc, u64 rate)
+{
+	u32 kib = (u32) min_t(u64, rate >> 10, U32_MAX);
+	unsigned long stamp = READ_ONCE(rocc_host_rate_stamp);
+	u64 budget, total;
+	s64 sum = 0;
+	int cpu;
+
+	if (!rocc_host_budget_mbps) {
+		// Budget was turned off: withdraw from the sum
+		rocc_host_withdraw(rocc);
+		return rate;
+	}
+	if (kib != rocc->host_rate) {
+		this_cpu_add(rocc_host_rate_pcpu, (s64) kib - rocc->host_rate);
+		rocc->host_rate = kib;
+	}
+	if (stamp != jiffies && cmpxchg(&rocc_host_rate_stamp, stamp, jiffies) == stamp) {
+		for_each_possible_cpu(cpu)
+			sum += per_cpu(rocc_host_rate_pcpu, cpu);
+		atomic64_set(&rocc_host_rate, max_t(s64, sum, 0));
+	}
+
+	budget = (u64) rocc_host_budget_mbps * 1000000 / 8;
+	total = (u64) atomic64_read(&rocc_host_rate) << 10;
+	if (total <= budget)
+		return rate;
+	return div64_u64(rate * (budget >> 10), total >> 10);
+}
+
+// Number of times to halve the pacing rate after `gap_us` without ACKs
+static u32 rocc_starve_shift(const struct rocc_data *rocc, u32 gap_us)
+{
+	u64 starve_us;
+
+	if (!rocc_starve_rtts || rocc->min_rtt_us == U32_MAX)
+		return 0;
+	starve_us = (u64) rocc->min_rtt_us * rocc_starve_rtts;
+	return (u32) min_t(u64, div64_u64(gap_us, starve_us), rocc_starve_max_shift);
+}
+
+// Pacing rate after `shift` halvings, but at least rocc_min_cwnd per min RTT
+static u64 rocc_starve_rate(struct sock *sk, u64 rate, u32 shift)
+{
+	struct rocc_data *rocc = inet_csk_ca(sk);
+
+	return max(rate >> shift, rocc_pacing_rate(rocc_min_cwnd, rocc_get_mss(tcp_sk(sk)),
+						   rocc->min_rtt_us));
+}
+
+/* Loss threshold (x/1024) for this flow under rocc_loss_autotune. On each new
+ * history interval (`pushed`), fold the long window's loss rate into the
+ * background estimate. The estimate tracks the lower envelope of the loss
+ * rate: it falls quickly and rises slowly, so that congestion episodes, which
+ * the threshold is there to catch, barely move it.
+ */
+static u32 rocc_autotune_thresh(struct rocc_data *rocc, const struct rocc_window *w,
+				bool pushed)
+{
+	u32 total = w->pkts_net_acked + w->pkts_net_lost;
+	u32 bg = rocc->loss_bg, rate, thresh;
+
+	if (pushed && total >= ROCC_LOSS_BG_MIN_PKTS) {
+		rate = (u32) div_u64((u64) w->pkts_net_lost << (10 + ROCC_LOSS_BG_SHIFT), total);
+		if (rate < bg)
+			bg -= (bg - rate) >> 3;
+		else
+			bg += (rate - bg) >> 6;
+		rocc->loss_bg = bg;
+	}
+	thresh = clamp((bg * rocc_loss_autotune_gain) >> ROCC_LOSS_BG_SHIFT,
+		       rocc_loss_thresh_min, rocc_loss_thresh_max);
+	if (pushed)
+		this_cpu_inc(rocc_thresh_stats.hist[min(thresh / 16, ROCC_THRESH_BUCKETS - 1U)]);
+	return thresh;
+}
+
+static void rocc_override(u32 *param, u32 value)
+{
+	if (value)
+		*param = value;
+}
+
+// Parameters for this flow: module defaults, overridden by its policy profile
+// and then by its A/B arm
+static void rocc_flow_profile(const struct rocc_data *rocc, struct rocc_profile *prof)
+{
+	const struct rocc_profile *p;
+
+	prof->loss_thresh = 0;
+	prof->alpha = rocc_alpha;
+	prof->hist_mult = rocc_long_hist_mult;
+	prof->pacing_gain = 1024;
+	prof->min_cwnd = rocc_min_cwnd;
+	if (rocc->profile) {
+		p = &rocc_profiles[rocc->profile];
+		rocc_override(&prof->loss_thresh, READ_ONCE(p->loss_thresh));
+		rocc_override(&prof->alpha, READ_ONCE(p->alpha));
+		rocc_override(&prof->hist_mult, READ_ONCE(p->hist_mult));
+		rocc_override(&prof->pacing_gain, READ_ONCE(p->pacing_gain));
+		rocc_override(&prof->min_cwnd, READ_ONCE(p->min_cwnd));
+	}
+	if (rocc->arm != ROCC_AB_NONE) {
+		rocc_override(&prof->loss_thresh, rocc_ab_loss_thresh[rocc->arm]);
+		rocc_override(&prof->alpha, rocc_ab_alpha[rocc->arm]);
+		rocc_override(&prof->hist_mult, rocc_ab_hist_mult[rocc->arm]);
+	}
+}
+
+static void rocc_patho_report(struct sock *sk, struct rocc_data *rocc,
+			      enum rocc_pathology kind, u32 rounds)
+{
+	struct tcp_sock *tsk = tcp_sk(sk);
+
+	this_cpu_inc(rocc_patho_stats.count[kind]);
+	if (trace_rocc_pathology_enabled() && __ratelimit(&rocc_patho_ratelimit))
+		trace_rocc_pathology(sk, kind, rounds, tsk->snd_cwnd,
+				     sk->sk_pacing_rate, rocc_bw_bytes(rocc, tsk),
+				     rocc->min_rtt_us, tsk->srtt_us >> 3);
+}
+
+// Count one more round of a pathology, or reset the count. Reports once per
+// `rocc_patho_rounds` consecutive rounds.
+static void rocc_patho_round(struct sock *sk, struct rocc_data *rocc, u16 *rounds,
+			     bool seen, enum rocc_pathology kind)
+{
+	if (!seen) {
+		*rounds = 0;
+		return;
+	}
+	if (++*rounds >= max(rocc_patho_rounds, 1U)) {
+		rocc_patho_report(sk, rocc, kind, *rounds);
+		*rounds = 0;
+	}
+}
+
+/* Pathology detector, run after each processed ACK with the new cwnd and
+ * pacing rate in place. Round-based checks run when a min RTT has passed
+ * since the round started.
+ */
+static void rocc_patho_update(struct sock *sk, struct rocc_data *rocc, u32 now_us,
+			      u32 min_cwnd, bool decreased, bool app_limited)
+{
+	struct rocc_patho *p = rocc_patho(rocc);
+	u32 cwnd = tcp_sk(sk)->snd_cwnd;
+	u64 pacing, bw;
+
+	if (rocc->min_rtt_us == U32_MAX)
+		return;
+	if (decreased) {
+		if (p->last_decrease_us && now_us - p->last_decrease_us < rocc->min_rtt_us)
+			rocc_patho_report(sk, rocc, ROCC_PATHO_REPEAT_DECREASE, 0);
+		p->last_decrease_us = now_us ? now_us : 1;
+	}
+	if (!p->round_start_us) {
+		p->round_start_us = now_us;
+		p->round_min_cwnd = p->round_max_cwnd = cwnd;
+		return;
+	}
+	p->round_min_cwnd = min(p->round_min_cwnd, cwnd);
+	p->round_max_cwnd = max(p->round_max_cwnd, cwnd);
+	if (now_us - p->round_start_us < rocc->min_rtt_us)
+		return;
+
+	rocc_patho_round(sk, rocc, &p->min_cwnd_rounds, p->round_max_cwnd <= min_cwnd,
+			 ROCC_PATHO_MIN_CWND);
+	rocc_patho_round(sk, rocc, &p->osc_rounds,
+			 (u64) p->round_max_cwnd > 2 * (u64) p->round_min_cwnd,
+			 ROCC_PATHO_OSCILLATION);
+	// An app-limited flow legitimately paces above what it delivers
+	pacing = sk->sk_pacing_rate;
+	bw = rocc_bw_bytes(rocc, tcp_sk(sk));
+	rocc_patho_round(sk, rocc, &p->rate_rounds,
+			 !app_limited && bw &&
+			 (pacing > bw * rocc_patho_rate_ratio || pacing * rocc_patho_rate_ratio < bw),
+			 ROCC_PATHO_RATE_MISMATCH);
+	p->round_start_us = now_us ? now_us : 1;
+	p->round_min_cwnd = p->round_max_cwnd = cwnd;
+}
+
+// Add one ACK to the metrics of the socket's A/B arm. `cwnd` is the new cwnd;
+// tsk->snd_cwnd is still the one in force over the last `ack_gap_us`.
+// `min_cwnd` is the flow's floor, from its profile.
+static void rocc_ab_account(struct rocc_data *rocc, struct tcp_sock *tsk,
+			    const struct rate_sample *rs, u32 cwnd, u32 ack_gap_us,
+			    u32 min_cwnd, bool decreased)
+{
+	u8 arm = rocc->arm;
+
+	this_cpu_add(rocc_ab_stats.arm[arm].delivered_bytes,
+		     (u64) rs->acked_sacked * rocc_get_mss(tsk));
+	if (rs->losses)
+		this_cpu_add(rocc_ab_stats.arm[arm].lost_pkts, rs->losses);
+	if (decreased)
+		this_cpu_inc(rocc_ab_stats.arm[arm].decreases);
+	this_cpu_inc(rocc_ab_stats.arm[arm].acks);
+	this_cpu_add(rocc_ab_stats.arm[arm].cwnd_sum, cwnd);
+	if (tsk->snd_cwnd <= min_cwnd)
+		this_cpu_add(rocc_ab_stats.arm[arm].min_cwnd_us, ack_gap_us);
+}
+
+// Remove `spurious` losses from the history. These are retransmissions that
+// DSACK showed were not needed, typically because RACK marked reordered
+// packets lost too early.
+static void rocc_discount_losses(struct rocc_data *rocc, u32 spurious)
+{
+	rocc_hist_discount(rocc->intervals, rocc_num_intervals_mask, rocc->intervals_head,
+			   spurious);
+}
+
+// How many of the segments DSACKed since the last sample were retransmissions
+// of segments marked lost. DSACKs for TLP probes, which were never marked
+// lost, and for duplicates outside a loss episode are not.
+static u32 rocc_spurious_losses(struct tcp_sock *tsk, struct rocc_data *rocc)
+{
+	u32 dsacked = tsk->dsack_dups - rocc->last_dsack_dups;
+
+	// The probe outstanding at the last sample was resolved by this ACK
+	if ((rocc->flags & ROCC_F_TLP_RETRANS) && !tsk->tlp_high_seq)
+		dsacked -= min(dsacked, 1U);
+	return tsk->undo_marker ? dsacked : 0;
+}
+
+/* Process one ACK. Returns the ROCC_PATH_* flags of the path taken, or -1 if
+ * the sample was skipped.
+ */
+static int rocc_do_sample(struct sock *sk, const struct rate_sample *rs)
 {
 	struct rocc_data *rocc = inet_csk_ca(sk);
 	struct tcp_sock *tsk = tcp_sk(sk);
-	u32 rtt_us;
-	u16 i, id;
-	u32 hist_us;
+	u32 rtt_us, sample_rtt_us;
+	u32 hist_us, short_hist_us;
 	u64 timestamp;
-	u32 interval_length;
-	// Number of packets acked and lost in the last `hist_us`
-	u32 pkts_acked, pkts_lost;
+	// Number of packets acked and lost in the last `hist_us` and
+	// `short_hist_us`
+	struct rocc_window w, short_w;
 	u32 cwnd;
-	bool loss_mode, app_limited;
+	u32 alpha_inc, alpha_dec;
+	bool loss_mode;
 	bool is_new_congestion_event;
+	bool is_random_loss;
+	bool pushed;
+	u32 starve_shift;
+	u32 loss_thresh;
+	u32 ack_gap_us;
+	struct rocc_profile prof;
+	bool decreased = false;
 
+	if (rocc->local) {
+		rocc_local_set_cwnd(tsk);
+		return -1;
+	}
 	if (!rocc_valid(rocc))
-		return;
+		return -1;
 
 	// Is rate sample valid?
 	if (rs->delivered < 0 || rs->interval_us < 0)
-		return;
+		return -1;
 
 	// Get initial RTT - as measured by SYN -> SYN-ACK.  If information
         // does not exist - use U32_MAX as RTT
@@ -110,93 +1151,237 @@ static void rocc_process_sample(struct sock *sk, const struct rate_sample *rs)
 	if (rtt_us < rocc->min_rtt_us)
 		rocc->min_rtt_us = rtt_us;
 
-	if (rocc->min_rtt_us == U32_MAX)
-		hist_us = U32_MAX;
+	rocc_flow_profile(rocc, &prof);
+	hist_us = rocc_horizon_us(rocc->min_rtt_us, prof.hist_mult);
+	short_hist_us = rocc_short_hist_us(rocc->min_rtt_us, rocc_short_hist_mult, hist_us);
+
+	if (tsk->dsack_dups != rocc->last_dsack_dups) {
+		if (rocc_undo_spurious)
+			rocc_discount_losses(rocc, rocc_spurious_losses(tsk, rocc));
+		rocc->last_dsack_dups = tsk->dsack_dups;
+	}
+	if (tsk->tlp_high_seq && tsk->tlp_retrans)
+		rocc->flags |= ROCC_F_TLP_RETRANS;
 	else
-		hist_us = 3 * rocc->min_rtt_us;
+		rocc->flags &= ~ROCC_F_TLP_RETRANS;
+	// The episode of the last decrease ended without an undo: everything
+	// sent before it is acknowledged and the stack is back in Open
+	if (rocc->prior_cwnd && inet_csk(sk)->icsk_ca_state == TCP_CA_Open &&
+	    !before(tsk->snd_una, rocc->last_decrease_seq))
+		rocc->prior_cwnd = 0;
+
+	if (rocc->remaining_bytes) {
+		rocc->remaining_bytes -= min_t(u64, rocc->remaining_bytes,
+					       (u64) rs->acked_sacked * rocc_get_mss(tsk));
+	}
+
+	// Per-ACK RTT sample, used to track queue build-up within an interval
+	sample_rtt_us = rs->rtt_us > 0 ? (u32) rs->rtt_us : U32_MAX;
 
 	// Update intervals
 	timestamp = tsk->tcp_mstamp; // Most recent send/receive
+	// ACKs that arrive after a long gap (thinned or delayed on the reverse
+	// path) carry stale feedback: do not grow on them, and pace slower.
+	// last_ack_us restarts on CA_EVENT_TX_START, so application idle
+	// periods, with nothing in flight, do not count.
+	ack_gap_us = (u32) timestamp - rocc->last_ack_us;
+	starve_shift = rocc_starve_shift(rocc, ack_gap_us);
+	rocc->last_ack_us = (u32) timestamp;
+	rocc_update_bw(rocc, rs, timestamp);
 
-	// The factor of 2 gives some headroom so that we always have
-	// sufficient history. We end up storing more history than needed, but
-	// that's ok
-	interval_length = 2 * hist_us / rocc_num_intervals + 1; // round up
-	if (rocc->intervals[rocc->intervals_head].start_us + interval_length < timestamp) {
-		// Push the buffer
-		rocc->intervals_head = (rocc->intervals_head - 1) & rocc_num_intervals_mask;
-		rocc->intervals[rocc->intervals_head].start_us = timestamp;
-		rocc->intervals[rocc->intervals_head].pkts_acked = rs->acked_sacked;
-		rocc->intervals[rocc->intervals_head].pkts_lost = rs->losses;
-		rocc->intervals[rocc->intervals_head].app_limited = rs->is_app_limited;
-	}
-	else {
-		rocc->intervals[rocc->intervals_head].pkts_acked += rs->acked_sacked;
-		rocc->intervals[rocc->intervals_head].pkts_lost += rs->losses;
-		rocc->intervals[rocc->intervals_head].app_limited |= rs->is_app_limited;
-	}
-
-	// Find the statistics from the last `hist` seconds
-	pkts_acked = 0;
-	pkts_lost = 0;
-	app_limited = false;
-	for (i = 0; i < rocc_num_intervals; ++i) {
-		id = (rocc->intervals_head + i) & rocc_num_intervals_mask;
-		pkts_acked += rocc->intervals[id].pkts_acked;
-		pkts_lost += rocc->intervals[id].pkts_lost;
-		app_limited |= rocc->intervals[id].app_limited;
-		if (rocc->intervals[id].start_us + hist_us < timestamp) {
-			break;
-		}
-	}
-
-	// CCMATIC RULE
-	/**
-	 * if(Ld_f[0][t] > Ld_f[0][t-1]):
-	 *     c_f[0][t] = max(0.01, 1/2v.c_f[0][t-1] + 0(S_f[0][t-1]-S_f[0][t-4]) + -1)
-	 * else:
-	 *     c_f[0][t] = max(0.01, 1/2v.c_f[0][t-1] + 1/2(S_f[0][t-1]-S_f[0][t-4]) + 1)
-	*/
+	pushed = rocc_hist_update(rocc->intervals, rocc_num_intervals_mask,
+				  &rocc->intervals_head, timestamp, hist_us,
+				  rs->acked_sacked, rs->losses, sample_rtt_us,
+				  rs->is_app_limited);
+	rocc_hist_window(rocc->intervals, rocc_num_intervals_mask,
+			 rocc->intervals_head, timestamp, hist_us, &w);
+	rocc_hist_window(rocc->intervals, rocc_num_intervals_mask,
+			 rocc->intervals_head, timestamp, short_hist_us, &short_w);
 
-	//
-	loss_mode = (u64) pkts_lost * 1024 > (u64) (pkts_acked + pkts_lost) * rocc_loss_thresh;
+	if (prof.loss_thresh)
+		loss_thresh = prof.loss_thresh;
+	else if (rocc_loss_autotune)
+		loss_thresh = rocc_autotune_thresh(rocc, &w, pushed);
+	else
+		loss_thresh = rocc_loss_thresh;
+	loss_mode = rocc_window_loss_mode(&short_w, &w, rocc_severe_loss_thresh, loss_thresh);
 	// NOTE: rs->last_end_seq requires kernel version >= 5.15.38
 	is_new_congestion_event = after(rs->last_end_seq, rocc->last_decrease_seq);
-	if(loss_mode && is_new_congestion_event) {
+	// Losses without queue build-up over the same window are likely random
+	// (e.g. wireless corruption), not congestion. Do not back off for them.
+	is_random_loss = false;
+	if (rocc_loss_classify && loss_mode && w.max_rtt_us != 0 &&
+	    rocc->min_rtt_us != U32_MAX) {
+		is_random_loss = (u64) (w.max_rtt_us - min(w.max_rtt_us, rocc->min_rtt_us)) * 1024
+			<= (u64) rocc->min_rtt_us * rocc_loss_classify_qdelay;
+	}
+	rocc_deadline_alpha(sk, rocc, timestamp, prof.alpha, &alpha_inc, &alpha_dec);
+	if (rocc->group)
+		alpha_inc = rocc_coupled_alpha(rocc, alpha_inc, tsk->snd_cwnd);
+	if(loss_mode && is_new_congestion_event && !is_random_loss) {
 		rocc->last_decrease_seq = tsk->snd_nxt;
-		cwnd = (tsk->snd_cwnd)/2 -1*rocc_alpha;
-		// ^ multiplicative decrement triggered on unique loss event.
+		rocc->prior_cwnd = tsk->snd_cwnd;
+		decreased = true;
+		cwnd = rocc_cwnd_decrease(tsk->snd_cwnd, alpha_dec);
 	}
 	else {
-		cwnd = (tsk->snd_cwnd + pkts_acked)/2 + 1*rocc_alpha;
+		cwnd = rocc_cwnd_increase(tsk->snd_cwnd, w.pkts_net_acked, alpha_inc);
 	}
 
-	// Do not decrease cwnd if app limited
-	if (app_limited && cwnd < tsk->snd_cwnd) {
+	// Do not decrease cwnd for want of data
+	if (cwnd < tsk->snd_cwnd && !rocc_may_shrink(&w, decreased)) {
 		cwnd = tsk->snd_cwnd;
 	}
+	if (starve_shift && cwnd > tsk->snd_cwnd)
+		cwnd = tsk->snd_cwnd;
+	// Do not grow cwnd when the host is short on socket memory
+	if (rocc_mem_pressure && cwnd > tsk->snd_cwnd && rocc_under_mem_pressure(sk)) {
+		cwnd = tsk->snd_cwnd;
+	}
+	// Bound queueing to a multiple of the estimated BDP
+	if (rocc_bdp_cap_gain)
+		cwnd = min(cwnd, rocc_bdp_cap(rocc));
 	// Lower bound clamp
-	cwnd = max(cwnd, rocc_min_cwnd);
+	cwnd = max(cwnd, prof.min_cwnd);
+	if (rocc->arm != ROCC_AB_NONE)
+		rocc_ab_account(rocc, tsk, rs, cwnd, ack_gap_us, prof.min_cwnd, decreased);
 	tsk->snd_cwnd = cwnd;
+	if (rocc->group) {
+		atomic_long_add((long) cwnd - rocc->group_cwnd, &rocc->group->total_cwnd);
+		rocc->group_cwnd = cwnd;
+	}
+
+	sk->sk_pacing_rate = rocc_pacing_rate(cwnd, rocc_get_mss(tsk), rocc->min_rtt_us);
+	if (prof.pacing_gain != 1024)
+		sk->sk_pacing_rate = (u64) sk->sk_pacing_rate * prof.pacing_gain >> 10;
+	if (starve_shift)
+		sk->sk_pacing_rate = rocc_starve_rate(sk, sk->sk_pacing_rate, starve_shift);
+	if (rocc_host_budget_mbps || rocc->host_rate)
+		sk->sk_pacing_rate = rocc_host_budget_share(rocc, sk->sk_pacing_rate);
+	// A flow that has sent all its data goes idle: it leaves the host sum
+	// so as not to hold budget the others could use, and rejoins on its
+	// first ACK after sending resumes
+	if (rocc->host_rate && !tcp_packets_in_flight(tsk) && tcp_write_queue_empty(sk))
+		rocc_host_withdraw(rocc);
 
-	sk->sk_pacing_rate = 1000000 * (u64) cwnd * rocc_get_mss(tsk) / rocc->min_rtt_us;
+	trace_rocc_sample(sk, cwnd, sk->sk_pacing_rate, rocc->min_rtt_us, rs->acked_sacked,
+			  rs->losses, loss_mode && !is_random_loss, w.app_limited, decreased);
+	if (rocc_patho_detect)
+		rocc_patho_update(sk, rocc, (u32) timestamp, prof.min_cwnd, decreased,
+				  w.app_limited);
 
 #ifdef ROCC_DEBUG
 	printk(KERN_INFO "rocc flow %u cwnd %u pacing %lu rtt %u mss %u timestamp %llu interval %ld", rocc->id, tsk->snd_cwnd, sk->sk_pacing_rate, rtt_us, tsk->mss_cache, timestamp, rs->interval_us);
-	printk(KERN_INFO "rocc pkts_acked %u hist_us %u pacing %lu loss_mode %d app_limited %d rs_limited %d", pkts_acked, hist_us, sk->sk_pacing_rate, (int)loss_mode, (int)app_limited, (int)rs->is_app_limited);
+	printk(KERN_INFO "rocc pkts_acked %u net_acked %u hist_us %u pacing %lu loss_mode %d random_loss %d app_limited %d rs_limited %d", w.pkts_acked, w.pkts_net_acked, hist_us, sk->sk_pacing_rate, (int)loss_mode, (int)is_random_loss, (int)w.app_limited, (int)rs->is_app_limited);
 	// for (i = 0; i < rocc_num_intervals; ++i) {
 	// 	id = (rocc->intervals_head + i) & rocc_num_intervals_mask;
-	// 	printk(KERN_INFO "rocc intervals %llu acked %u lost %u app_limited %d i %u id %u", rocc->intervals[id].start_us, rocc->intervals[id].pkts_acked, rocc->intervals[id].pkts_lost, (int)rocc->intervals[id].app_limited, i, id);
+	// 	printk(KERN_INFO "rocc intervals %llu acked %u lost %u app_limited %u i %u id %u", rocc->intervals[id].start_us, rocc->intervals[id].pkts_acked, rocc->intervals[id].pkts_lost, rocc->intervals[id].pkts_app_limited, i, id);
 	// }
 #endif
+	return (pushed ? ROCC_PATH_PUSH : 0) | (decreased ? ROCC_PATH_DECREASE : 0) |
+		(w.app_limited ? ROCC_PATH_APP_LIMITED : 0);
+}
+
+static void rocc_process_sample(struct sock *sk, const struct rate_sample *rs)
+{
+	u32 every = READ_ONCE(rocc_prof_every);
+	cycles_t start, cycles;
+	int path;
+
+	if (likely(!every) || this_cpu_inc_return(rocc_prof_tick) % every) {
+		rocc_do_sample(sk, rs);
+		return;
+	}
+	start = get_cycles();
+	path = rocc_do_sample(sk, rs);
+	cycles = get_cycles() - start;
+	if (path >= 0)
+		this_cpu_inc(rocc_prof_stats.hist[path][min_t(u32, ilog2(cycles | 1),
+							      ROCC_PROF_BUCKETS - 1)]);
 }
 
 static void rocc_release(struct sock *sk)
 {
 	struct rocc_data *rocc = inet_csk_ca(sk);
+	rocc_leave_group(rocc);
+	if (rocc->host_rate)
+		rocc_host_withdraw(rocc);
 	kfree(rocc->intervals);
 }
 
+/* TCP calls this when it finds that a loss episode was spurious (DSACK or
+ * timestamps). Revert RoCC's own decrease as well as the stack's reduction.
+ */
+static u32 rocc_undo_cwnd(struct sock *sk)
+{
+	struct rocc_data *rocc = inet_csk_ca(sk);
+	u32 cwnd = tcp_reno_undo_cwnd(sk);
+
+	if (rocc_valid(rocc) && rocc_undo_spurious) {
+		cwnd = max(cwnd, rocc->prior_cwnd);
+		rocc->prior_cwnd = 0;
+	}
+	return cwnd;
+}
+
+/* Report min RTT and delivery rate through INET_DIAG and TCP_CC_INFO, in
+ * BBR's format, so that they can be saved before a TCP_REPAIR migration.
+ */
+static size_t rocc_get_info(struct sock *sk, u32 ext, int *attr,
+			    union tcp_cc_info *info)
+{
+	struct rocc_data *rocc = inet_csk_ca(sk);
+	struct tcp_sock *tsk = tcp_sk(sk);
+	u64 bw, bdp;
+
+	if (!(ext & (1 << (INET_DIAG_BBRINFO - 1))) &&
+	    !(ext & (1 << (INET_DIAG_VEGASINFO - 1))))
+		return 0;
+
+	bw = rocc_bw_bytes(rocc, tsk);
+	bdp = ((u64) minmax_get(&rocc->bw) * rocc->min_rtt_us) >> BW_SCALE;
+	memset(&info->bbr, 0, sizeof(info->bbr));
+	info->bbr.bbr_bw_lo = (u32) bw;
+	info->bbr.bbr_bw_hi = (u32) (bw >> 32);
+	info->bbr.bbr_min_rtt = rocc->min_rtt_us;
+	// Gains are in BBR's units of 1/256: pacing is always one window per
+	// min RTT, and the cwnd gain is cwnd / estimated BDP
+	info->bbr.bbr_pacing_gain = 256;
+	info->bbr.bbr_cwnd_gain = bdp ? (u32) div64_u64((u64) tsk->snd_cwnd * 256, bdp) : 0;
+	*attr = INET_DIAG_BBRINFO;
+	return sizeof(info->bbr);
+}
+
+/* An RTO means no feedback for at least the RTO, and the pacing rate set by the
+ * last ACK would otherwise stay in force until the next one. Decay it by the
+ * time since that ACK, or since transmission restarted after idle.
+ *
+ * Transmission restarting with nothing in flight restarts the ACK gap: an idle
+ * application is not a starved reverse path.
+ */
+static void rocc_cwnd_event(struct sock *sk, enum tcp_ca_event event)
+{
+	struct rocc_data *rocc = inet_csk_ca(sk);
+	u32 gap_us, shift;
+
+	if (!rocc_valid(rocc))
+		return;
+	switch (event) {
+	case CA_EVENT_TX_START:
+		rocc->last_ack_us = (u32) tcp_clock_us();
+		break;
+	case CA_EVENT_LOSS:
+		gap_us = min(jiffies_to_usecs(tcp_jiffies32 - tcp_sk(sk)->rcv_tstamp),
+			     (u32) tcp_clock_us() - rocc->last_ack_us);
+		shift = rocc_starve_shift(rocc, gap_us);
+		if (shift)
+			sk->sk_pacing_rate = rocc_starve_rate(sk, sk->sk_pacing_rate, shift);
+		break;
+	default:
+		break;
+	}
+}
+
 static u32 rocc_ssthresh(struct sock *sk)
 {
 	return TCP_INFINITE_SSTHRESH; /* ROCC does not use ssthresh */
@@ -214,28 +1399,480 @@ static struct tcp_congestion_ops tcp_rocc_cong_ops __read_mostly = {
 	.release	= rocc_release,
 	.cong_control = rocc_process_sample,
 	/* Keep the windows static */
-	/* Since RoCC ccmatic does reduce cwnd on loss. We use reno's undo method.
+	/* Since RoCC ccmatic does reduce cwnd on loss. We use reno's undo method,
+	 * extended to also revert RoCC's own decrease.
 	 */
-	.undo_cwnd = tcp_reno_undo_cwnd,
+	.undo_cwnd = rocc_undo_cwnd,
 	/* Slow start threshold will not exist */
 	 .ssthresh = rocc_ssthresh,
 	.cong_avoid = rocc_cong_avoid,
+	.cwnd_event = rocc_cwnd_event,
+	.get_info = rocc_get_info,
+};
+
+/* Debugfs `loss_thresh`: histogram of the auto-tuned loss thresholds in use,
+ * one line per bucket: lowest threshold (x/1024) and count.
+ */
+static int rocc_thresh_stats_show(struct seq_file *m, void *v)
+{
+	u64 count;
+	int cpu, i;
+
+	for (i = 0; i < ROCC_THRESH_BUCKETS; ++i) {
+		count = 0;
+		for_each_possible_cpu(cpu)
+			count += per_cpu(rocc_thresh_stats, cpu).hist[i];
+		seq_printf(m, "%d %llu\n", 16 * i, count);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rocc_thresh_stats);
+
+/* Debugfs `ab`: metrics of each A/B arm since the module was loaded, one line
+ * per arm: arm flows delivered_bytes lost_pkts decreases mean_cwnd
+ * min_cwnd_ms.
+ */
+static int rocc_ab_stats_show(struct seq_file *m, void *v)
+{
+	struct rocc_arm_stats sum, *st;
+	int cpu, i;
+
+	seq_puts(m, "arm flows delivered_bytes lost_pkts decreases mean_cwnd min_cwnd_ms\n");
+	for (i = 0; i < ROCC_AB_MAX_ARMS; ++i) {
+		memset(&sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			st = &per_cpu(rocc_ab_stats, cpu).arm[i];
+			sum.flows += st->flows;
+			sum.delivered_bytes += st->delivered_bytes;
+			sum.lost_pkts += st->lost_pkts;
+			sum.decreases += st->decreases;
+			sum.acks += st->acks;
+			sum.cwnd_sum += st->cwnd_sum;
+			sum.min_cwnd_us += st->min_cwnd_us;
+		}
+		if (!sum.flows)
+			continue;
+		seq_printf(m, "%d %llu %llu %llu %llu %llu %llu\n", i, sum.flows,
+			   sum.delivered_bytes, sum.lost_pkts, sum.decreases,
+			   sum.acks ? div64_u64(sum.cwnd_sum, sum.acks) : 0,
+			   div_u64(sum.min_cwnd_us, USEC_PER_MSEC));
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rocc_ab_stats);
+
+/* Debugfs `pathologies`: number of times each pathology was detected since
+ * the module was loaded, one `name count` line each.
+ */
+static int rocc_patho_stats_show(struct seq_file *m, void *v)
+{
+	u64 count;
+	int cpu, i;
+
+	for (i = 0; i < ROCC_NUM_PATHOLOGIES; ++i) {
+		count = 0;
+		for_each_possible_cpu(cpu)
+			count += per_cpu(rocc_patho_stats, cpu).count[i];
+		seq_printf(m, "%s %llu\n", rocc_patho_names[i], count);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rocc_patho_stats);
+
+/* Debugfs `profile`: cost histograms of the profiled rocc_process_sample
+ * calls, one line per code path seen: the path's flags, then
+ * `BUCKET:COUNT` for each non-empty log2 bucket of cycles. Writing anything
+ * clears the histograms.
+ */
+static int rocc_prof_show(struct seq_file *m, void *v)
+{
+	static const char * const names[ROCC_NUM_PATHS] = {
+		"accumulate,increase", "push,increase",
+		"accumulate,decrease", "push,decrease",
+		"accumulate,increase,app_limited", "push,increase,app_limited",
+		"accumulate,decrease,app_limited", "push,decrease,app_limited",
+	};
+	u64 counts[ROCC_PROF_BUCKETS], total;
+	int cpu, path, i;
+
+	for (path = 0; path < ROCC_NUM_PATHS; ++path) {
+		total = 0;
+		for (i = 0; i < ROCC_PROF_BUCKETS; ++i) {
+			counts[i] = 0;
+			for_each_possible_cpu(cpu)
+				counts[i] += per_cpu(rocc_prof_stats, cpu).hist[path][i];
+			total += counts[i];
+		}
+		if (!total)
+			continue;
+		seq_printf(m, "%s", names[path]);
+		for (i = 0; i < ROCC_PROF_BUCKETS; ++i) {
+			if (counts[i])
+				seq_printf(m, " %llu:%llu", 1ULL << i, counts[i]);
+		}
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
+static int rocc_prof_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, rocc_prof_show, NULL);
+}
+
+static ssize_t rocc_prof_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(&rocc_prof_stats, cpu), 0, sizeof(struct rocc_prof_stats));
+	return count;
+}
+
+static const struct file_operations rocc_prof_fops = {
+	.owner = THIS_MODULE,
+	.open = rocc_prof_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = rocc_prof_write,
+};
+
+/* Debugfs `policy`: profiles and the rules that select them. Writing replaces
+ * the whole policy; it must be written in one write(), e.g. with
+ * `cat policy.txt > policy`. An empty write clears it. One entry per line:
+ *
+ *   profile ID [loss_thresh=N] [alpha=N] [hist_mult=N] [pacing_gain=N] [min_cwnd=N]
+ *   cgroup CGROUP_ID PROFILE
+ *   port DST_PORT PROFILE
+ *   prefix DST_ADDR/LEN PROFILE
+ *
+ * Profile IDs are 1 to ROCC_MAX_PROFILES - 1; unset fields keep the module
+ * default. Lines starting with '#' are ignored. New sockets pick up the new
+ * policy; existing ones keep their profile index, whose fields change with it.
+ */
+static int rocc_parse_profile(char *args, struct rocc_profile *profiles)
+{
+	// In the order of the fields of struct rocc_profile
+	static const char * const names[] = {
+		"loss_thresh", "alpha", "hist_mult", "pacing_gain", "min_cwnd",
+	};
+	char *tok, *val;
+	u32 id, v, *fields;
+	int i;
+
+	tok = strsep(&args, " \t");
+	if (!tok || kstrtou32(tok, 10, &id) || !id || id >= ROCC_MAX_PROFILES)
+		return -EINVAL;
+	fields = (u32 *) &profiles[id];
+	while ((tok = strsep(&args, " \t"))) {
+		if (!*tok)
+			continue;
+		val = strchr(tok, '=');
+		if (!val)
+			return -EINVAL;
+		*val++ = 0;
+		i = match_string(names, ARRAY_SIZE(names), tok);
+		if (i < 0 || kstrtou32(val, 10, &v))
+			return -EINVAL;
+		fields[i] = v;
+	}
+	return 0;
+}
+
+static int rocc_parse_rule(const char *kind, char *args, struct rocc_policy *policy)
+{
+	struct rocc_rule *rule = &policy->rules[policy->num_rules];
+	char *target, *slash;
+	u32 profile, len;
+	int i;
+
+	target = strsep(&args, " \t");
+	if (!target || !args || kstrtou32(strim(args), 10, &profile) || !profile ||
+	    profile >= ROCC_MAX_PROFILES)
+		return -EINVAL;
+	rule->profile = profile;
+
+	if (!strcmp(kind, "cgroup")) {
+		rule->kind = ROCC_RULE_CGROUP;
+		if (kstrtou64(target, 10, &rule->key))
+			return -EINVAL;
+		hash_add(policy->cgroups, &rule->node, rule->key);
+	} else if (!strcmp(kind, "port")) {
+		rule->kind = ROCC_RULE_PORT;
+		if (kstrtou64(target, 10, &rule->key) || rule->key > U16_MAX)
+			return -EINVAL;
+		hash_add(policy->ports, &rule->node, rule->key);
+	} else if (!strcmp(kind, "prefix")) {
+		rule->kind = ROCC_RULE_PREFIX;
+		slash = strchr(target, '/');
+		if (!slash || kstrtou32(slash + 1, 10, &len))
+			return -EINVAL;
+		*slash = 0;
+		if (in4_pton(target, -1, rule->prefix.s6_addr + 12, -1, NULL) && len <= 32) {
+			rule->prefix.s6_addr16[5] = 0xffff;
+			len += 96;
+		} else if (!in6_pton(target, -1, rule->prefix.s6_addr, -1, NULL) || len > 128) {
+			return -EINVAL;
+		}
+		rule->len = len;
+		ipv6_addr_prefix(&rule->prefix, &rule->prefix, len);
+		hash_add(policy->prefixes, &rule->node, rocc_prefix_hash(&rule->prefix, len));
+		// Keep prefix_lens sorted, longest first
+		for (i = 0; i < policy->num_prefix_lens && policy->prefix_lens[i] > len; ++i)
+			;
+		if (i == policy->num_prefix_lens || policy->prefix_lens[i] != len) {
+			memmove(&policy->prefix_lens[i + 1], &policy->prefix_lens[i],
+				policy->num_prefix_lens - i);
+			policy->prefix_lens[i] = len;
+			++policy->num_prefix_lens;
+		}
+	} else {
+		return -EINVAL;
+	}
+	++policy->num_rules;
+	return 0;
+}
+
+static ssize_t rocc_policy_write(struct file *file, const char __user *ubuf,
+				 size_t count, loff_t *ppos)
+{
+	struct rocc_profile profiles[ROCC_MAX_PROFILES] = {};
+	struct rocc_policy *policy, *old;
+	char *buf, *cur, *line, *kind;
+	u32 lines = 0;
+	int ret = 0, i;
+
+	if (*ppos || count > 64 * ROCC_POLICY_MAX_RULES)
+		return -EINVAL;
+	buf = memdup_user_nul(ubuf, count);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+	for (cur = buf; *cur; ++cur)
+		lines += *cur == '\n';
+	policy = kvzalloc(struct_size(policy, rules, min_t(u32, lines + 1, ROCC_POLICY_MAX_RULES)),
+			  GFP_KERNEL);
+	if (!policy) {
+		kfree(buf);
+		return -ENOMEM;
+	}
+	hash_init(policy->cgroups);
+	hash_init(policy->ports);
+	hash_init(policy->prefixes);
+
+	cur = buf;
+	while ((line = strsep(&cur, "\n"))) {
+		line = strim(line);
+		if (!*line || *line == '#')
+			continue;
+		kind = strsep(&line, " \t");
+		if (!line) {
+			ret = -EINVAL;
+		} else if (!strcmp(kind, "profile")) {
+			ret = rocc_parse_profile(line, profiles);
+		} else if (policy->num_rules == ROCC_POLICY_MAX_RULES) {
+			ret = -ENOSPC;
+		} else {
+			ret = rocc_parse_rule(kind, line, policy);
+		}
+		if (ret)
+			break;
+	}
+	kfree(buf);
+	if (ret) {
+		kvfree(policy);
+		return ret;
+	}
+
+	mutex_lock(&rocc_policy_mutex);
+	for (i = 1; i < ROCC_MAX_PROFILES; ++i) {
+		WRITE_ONCE(rocc_profiles[i].loss_thresh, profiles[i].loss_thresh);
+		WRITE_ONCE(rocc_profiles[i].alpha, profiles[i].alpha);
+		WRITE_ONCE(rocc_profiles[i].hist_mult, profiles[i].hist_mult);
+		WRITE_ONCE(rocc_profiles[i].pacing_gain, profiles[i].pacing_gain);
+		WRITE_ONCE(rocc_profiles[i].min_cwnd, profiles[i].min_cwnd);
+	}
+	old = rcu_replace_pointer(rocc_policy, policy, lockdep_is_held(&rocc_policy_mutex));
+	mutex_unlock(&rocc_policy_mutex);
+	if (old)
+		kvfree_rcu(old, rcu);
+	return count;
+}
+
+static int rocc_policy_show(struct seq_file *m, void *v)
+{
+	const struct rocc_profile *p;
+	struct rocc_policy *policy;
+	struct rocc_rule *rule;
+	u32 i;
+
+	mutex_lock(&rocc_policy_mutex);
+	for (i = 1; i < ROCC_MAX_PROFILES; ++i) {
+		p = &rocc_profiles[i];
+		if (p->loss_thresh || p->alpha || p->hist_mult || p->pacing_gain || p->min_cwnd)
+			seq_printf(m, "profile %u loss_thresh=%u alpha=%u hist_mult=%u pacing_gain=%u min_cwnd=%u\n",
+				   i, p->loss_thresh, p->alpha, p->hist_mult,
+				   p->pacing_gain, p->min_cwnd);
+	}
+	policy = rcu_dereference_protected(rocc_policy, lockdep_is_held(&rocc_policy_mutex));
+	for (i = 0; policy && i < policy->num_rules; ++i) {
+		rule = &policy->rules[i];
+		if (rule->kind == ROCC_RULE_CGROUP)
+			seq_printf(m, "cgroup %llu %u\n", rule->key, rule->profile);
+		else if (rule->kind == ROCC_RULE_PORT)
+			seq_printf(m, "port %llu %u\n", rule->key, rule->profile);
+		else if (ipv6_addr_v4mapped(&rule->prefix))
+			seq_printf(m, "prefix %pI4/%u %u\n", &rule->prefix.s6_addr32[3],
+				   rule->len - 96, rule->profile);
+		else
+			seq_printf(m, "prefix %pI6c/%u %u\n", &rule->prefix, rule->len,
+				   rule->profile);
+	}
+	mutex_unlock(&rocc_policy_mutex);
+	return 0;
+}
+
+static int rocc_policy_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, rocc_policy_show, NULL);
+}
+
+static const struct file_operations rocc_policy_fops = {
+	.owner = THIS_MODULE,
+	.open = rocc_policy_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = rocc_policy_write,
+};
+
+/* Debugfs `restore`: save state for sockets about to be restored with
+ * TCP_REPAIR. One line per socket:
+ *
+ *   SRC_ADDR SRC_PORT DST_ADDR DST_PORT MIN_RTT_US CWND BW_BYTES_PER_SEC
+ *
+ * A write may hold many lines, up to ROCC_RESTORE_MAX_WRITE bytes, and is
+ * taken whole or not at all. Entries are used once, and expire after ROCC_RESTORE_TIMEOUT.
+ */
+static int rocc_parse_saved_state(char *line, struct list_head *states)
+{
+	struct rocc_saved_state *s;
+	char saddr[64], daddr[64];
+	u16 sport, dport;
+
+	s = kzalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return -ENOMEM;
+	if (sscanf(line, "%63s %hu %63s %hu %u %u %llu", saddr, &sport, daddr, &dport,
+		   &s->min_rtt_us, &s->cwnd, &s->bw) != 7)
+		goto invalid;
+	if (in4_pton(saddr, -1, s->saddr.s6_addr + 12, -1, NULL) &&
+	    in4_pton(daddr, -1, s->daddr.s6_addr + 12, -1, NULL)) {
+		s->saddr.s6_addr16[5] = 0xffff;
+		s->daddr.s6_addr16[5] = 0xffff;
+	} else if (!in6_pton(saddr, -1, s->saddr.s6_addr, -1, NULL) ||
+		   !in6_pton(daddr, -1, s->daddr.s6_addr, -1, NULL)) {
+		goto invalid;
+	}
+	s->sport = htons(sport);
+	s->dport = htons(dport);
+	s->expires = jiffies + ROCC_RESTORE_TIMEOUT;
+	list_add_tail(&s->list, states);
+	return 0;
+
+invalid:
+	kfree(s);
+	return -EINVAL;
+}
+
+static ssize_t rocc_restore_write(struct file *file, const char __user *ubuf,
+				  size_t count, loff_t *ppos)
+{
+	struct rocc_saved_state *s, *tmp;
+	LIST_HEAD(states);
+	char *buf, *cur, *line;
+	int ret = 0;
+
+	if (count > ROCC_RESTORE_MAX_WRITE)
+		return -EINVAL;
+	buf = memdup_user_nul(ubuf, count);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+	cur = buf;
+	while ((line = strsep(&cur, "\n"))) {
+		line = strim(line);
+		if (!*line)
+			continue;
+		ret = rocc_parse_saved_state(line, &states);
+		if (ret)
+			break;
+	}
+	kfree(buf);
+	if (ret) {
+		list_for_each_entry_safe(s, tmp, &states, list)
+			kfree(s);
+		return ret;
+	}
+
+	spin_lock_bh(&rocc_saved_states_lock);
+	list_splice(&states, &rocc_saved_states);
+	spin_unlock_bh(&rocc_saved_states_lock);
+	return count;
+}
+
+static const struct file_operations rocc_restore_fops = {
+	.owner = THIS_MODULE,
+	.write = rocc_restore_write,
 };
 
 /* Kernel module section */
 
+// Remove the debugfs files and free what was written through them
+static void rocc_debugfs_remove(void)
+{
+	struct rocc_saved_state *s, *tmp;
+
+	debugfs_remove_recursive(rocc_debugfs_dir);
+	// No socket uses RoCC anymore, so the policy has no readers
+	synchronize_rcu();
+	kvfree(rcu_dereference_protected(rocc_policy, true));
+	list_for_each_entry_safe(s, tmp, &rocc_saved_states, list)
+		kfree(s);
+}
+
 static int __init rocc_register(void)
 {
+	int ret;
+
 	BUILD_BUG_ON(sizeof(struct rocc_data) > ICSK_CA_PRIV_SIZE);
 #ifdef ROCC_DEBUG
 	printk(KERN_INFO "rocc init reg\n");
 #endif
-	return tcp_register_congestion_control(&tcp_rocc_cong_ops);
+#ifdef ROCC_HAVE_KFUNCS
+	// Optional: without BTF the module still works, minus the kfuncs
+	ret = register_btf_kfunc_id_set(BPF_PROG_TYPE_SOCK_OPS, &rocc_kfunc_set);
+	if (ret)
+		pr_warn("tcp_rocc_ccmatic: sockops kfuncs unavailable (%d)\n", ret);
+#endif
+	rocc_debugfs_dir = debugfs_create_dir("tcp_rocc_ccmatic", NULL);
+	debugfs_create_file("restore", 0200, rocc_debugfs_dir, NULL, &rocc_restore_fops);
+	debugfs_create_file("loss_thresh", 0444, rocc_debugfs_dir, NULL, &rocc_thresh_stats_fops);
+	debugfs_create_file("ab", 0444, rocc_debugfs_dir, NULL, &rocc_ab_stats_fops);
+	debugfs_create_file("policy", 0644, rocc_debugfs_dir, NULL, &rocc_policy_fops);
+	debugfs_create_file("profile", 0644, rocc_debugfs_dir, NULL, &rocc_prof_fops);
+	debugfs_create_file("pathologies", 0444, rocc_debugfs_dir, NULL, &rocc_patho_stats_fops);
+	ratelimit_set_flags(&rocc_patho_ratelimit, RATELIMIT_MSG_ON_RELEASE);
+	ret = tcp_register_congestion_control(&tcp_rocc_cong_ops);
+	if (ret)
+		rocc_debugfs_remove();
+	return ret;
 }
 
 static void __exit rocc_unregister(void)
 {
 	tcp_unregister_congestion_control(&tcp_rocc_cong_ops);
+	rocc_debugfs_remove();
 }
 
 module_init(rocc_register);
@@ -244,3 +1881,6 @@ module_exit(rocc_unregister);
 MODULE_AUTHOR("Venkat Arun <venkatarun95@gmail.com>");
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("TCP RoCC CCmatic (Robust Congestion Control CCmatic)");
+#ifdef ROCC_GIT_REV
+MODULE_VERSION(ROCC_GIT_REV);
+#endif
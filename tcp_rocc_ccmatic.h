@@ -0,0 +1,17 @@
+/* RoCC (Robust Congestion Control)
+ *
+ * Interface exported to other kernel code
+ */
+
+#ifndef _TCP_ROCC_CCMATIC_H
+#define _TCP_ROCC_CCMATIC_H
+
+#include <net/sock.h>
+
+// Give a RoCC socket a completion target. See rocc_set_deadline().
+void rocc_set_deadline(struct sock *sk, u32 budget_us, u64 remaining_bytes);
+// Couple the congestion control of `sk` with other sockets that use the same
+// key. See rocc_couple().
+int rocc_couple(struct sock *sk, u32 key);
+
+#endif /* _TCP_ROCC_CCMATIC_H */
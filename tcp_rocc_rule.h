@@ -0,0 +1,264 @@
+/* RoCC (Robust Congestion Control)
+ *
+ * The RoCC control law: interval history, loss test, CCmatic update and
+ * pacing computation. Shared by the kernel module and by userspace users (see
+ * tools/rocc_controller.hpp), so that both run the same rule; the kernel's
+ * optional modifiers on top of it are listed in rocc_controller.hpp.
+ * Everything here
+ * is allocation-free and `static inline`, and must compile as kernel C, plain
+ * C and C++.
+ */
+
+#ifndef _TCP_ROCC_RULE_H
+#define _TCP_ROCC_RULE_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+#ifndef U32_MAX
+#define U32_MAX ((u32)~0U)
+#endif
+#endif
+
+// Should be a power of two so rocc_num_intervals_mask can be set
+static const u16 rocc_num_intervals = 16;
+// rocc_num_intervals expressed as a mask. It is always equal to
+// rocc_num_intervals-1
+static const u16 rocc_num_intervals_mask = 15;
+static const u32 rocc_min_cwnd = 2;
+// Maximum tolerable loss rate, expressed as `loss_thresh / 1024`. Calculations
+// are faster if things are powers of 2
+static const u64 rocc_loss_thresh = 64;
+static const u32 rocc_alpha = 1;
+// Loss is judged on two horizons. A loss rate above
+// `ROCC_SEVERE_LOSS_THRESH / 1024` over the short horizon of
+// `ROCC_SHORT_HIST_MULT` min RTTs triggers a decrease right away; milder loss
+// must exceed the loss threshold over the long horizon, rocc_hist_us(). A
+// severe threshold of 1024 turns the short test off.
+#define ROCC_SHORT_HIST_MULT 1
+#define ROCC_SEVERE_LOSS_THRESH 256
+
+// To keep track of the number of packets acked over a short period of time
+struct rocc_interval {
+	// Starting time of this interval
+	u64 start_us;
+	u32 pkts_acked;
+	u32 pkts_lost;
+	// Smallest RTT sample seen in this interval (U32_MAX if none)
+	u32 rtt_us;
+	// Packets in pkts_acked that were delivered while app-limited
+	u32 pkts_app_limited;
+	// Packets in pkts_lost that were reported by app-limited samples
+	u32 pkts_lost_app_limited;
+};
+
+// Statistics over the last `hist_us` of history
+struct rocc_window {
+	u32 pkts_acked;
+	u32 pkts_lost;
+	// Packets acked and lost while not app-limited. Only these say
+	// anything about the network, so the loss test and the increase term
+	// use them.
+	u32 pkts_net_acked;
+	u32 pkts_net_lost;
+	// Largest per-interval RTT in the window (0 if none)
+	u32 max_rtt_us;
+	// Most of the window's deliveries were app-limited
+	bool app_limited;
+};
+
+static inline void rocc_hist_reset(struct rocc_interval *intervals, u16 mask)
+{
+	u16 i;
+
+	for (i = 0; i <= mask; ++i) {
+		intervals[i].start_us = 0;
+		intervals[i].pkts_acked = 0;
+		intervals[i].pkts_lost = 0;
+		intervals[i].rtt_us = U32_MAX;
+		intervals[i].pkts_app_limited = 0;
+		intervals[i].pkts_lost_app_limited = 0;
+	}
+}
+
+// A horizon of `mult` min RTTs, or U32_MAX while min RTT is unknown
+static inline u32 rocc_horizon_us(u32 min_rtt_us, u32 mult)
+{
+	u64 us = (u64) min_rtt_us * (mult ? mult : 1);
+
+	if (min_rtt_us == U32_MAX || us >= U32_MAX)
+		return U32_MAX;
+	return (u32) us;
+}
+
+// Length of history used for the loss test and increase term
+static inline u32 rocc_hist_us(u32 min_rtt_us)
+{
+	return rocc_horizon_us(min_rtt_us, 3);
+}
+
+// The short loss horizon of `short_mult` min RTTs, never longer than the long
+// one, `hist_us`
+static inline u32 rocc_short_hist_us(u32 min_rtt_us, u32 short_mult, u32 hist_us)
+{
+	u32 us = rocc_horizon_us(min_rtt_us, short_mult);
+
+	return us < hist_us ? us : hist_us;
+}
+
+/* Add one ACK's worth of information to the circular history `intervals` of
+ * `mask + 1` entries, whose newest entry is `*head`. Starts a new interval if
+ * the current one is older than its length. Returns true if it did.
+ */
+static inline bool rocc_hist_update(struct rocc_interval *intervals, u16 mask,
+				    u16 *head, u64 now_us, u32 hist_us,
+				    u32 acked, u32 lost, u32 rtt_us,
+				    bool app_limited)
+{
+	struct rocc_interval *cur = &intervals[*head];
+	// The factor of 2 gives some headroom so that we always have
+	// sufficient history. We end up storing more history than needed, but
+	// that's ok
+	u64 interval_length = 2 * (u64) hist_us / (mask + 1) + 1; // round up
+
+	if (cur->start_us + interval_length < now_us) {
+		// Push the buffer
+		*head = (*head - 1) & mask;
+		cur = &intervals[*head];
+		cur->start_us = now_us;
+		cur->pkts_acked = acked;
+		cur->pkts_lost = lost;
+		cur->rtt_us = rtt_us;
+		cur->pkts_app_limited = app_limited ? acked : 0;
+		cur->pkts_lost_app_limited = app_limited ? lost : 0;
+		return true;
+	}
+	cur->pkts_acked += acked;
+	cur->pkts_lost += lost;
+	cur->rtt_us = rtt_us < cur->rtt_us ? rtt_us : cur->rtt_us;
+	if (app_limited) {
+		cur->pkts_app_limited += acked;
+		cur->pkts_lost_app_limited += lost;
+	}
+	return false;
+}
+
+// Find the statistics from the last `hist_us`
+static inline void rocc_hist_window(const struct rocc_interval *intervals,
+				    u16 mask, u16 head, u64 now_us, u32 hist_us,
+				    struct rocc_window *w)
+{
+	const struct rocc_interval *it;
+	u32 pkts_app_limited = 0, pkts_lost_app_limited = 0;
+	u16 i;
+
+	w->pkts_acked = 0;
+	w->pkts_lost = 0;
+	w->max_rtt_us = 0;
+	for (i = 0; i <= mask; ++i) {
+		it = &intervals[(head + i) & mask];
+		w->pkts_acked += it->pkts_acked;
+		w->pkts_lost += it->pkts_lost;
+		pkts_app_limited += it->pkts_app_limited;
+		pkts_lost_app_limited += it->pkts_lost_app_limited;
+		if (it->rtt_us != U32_MAX && it->rtt_us > w->max_rtt_us)
+			w->max_rtt_us = it->rtt_us;
+		if (it->start_us + hist_us < now_us)
+			break;
+	}
+	w->pkts_net_acked = w->pkts_acked - pkts_app_limited;
+	w->pkts_net_lost = w->pkts_lost - pkts_lost_app_limited;
+	w->app_limited = pkts_app_limited > 0 && pkts_app_limited * 2 >= w->pkts_acked;
+}
+
+/* Remove `spurious` losses, which turned out not to be (e.g. retransmissions
+ * that DSACK showed were not needed), from the history, newest intervals
+ * first. Network-limited losses go first.
+ */
+static inline void rocc_hist_discount(struct rocc_interval *intervals, u16 mask,
+				      u16 head, u32 spurious)
+{
+	struct rocc_interval *it;
+	u32 n;
+	u16 i;
+
+	for (i = 0; i <= mask && spurious > 0; ++i) {
+		it = &intervals[(head + i) & mask];
+		n = spurious < it->pkts_lost ? spurious : it->pkts_lost;
+		it->pkts_lost -= n;
+		if (it->pkts_lost_app_limited > it->pkts_lost)
+			it->pkts_lost_app_limited = it->pkts_lost;
+		spurious -= n;
+	}
+}
+
+// Is the loss rate above `loss_thresh / 1024`?
+static inline bool rocc_loss_mode(u32 pkts_acked, u32 pkts_lost, u64 loss_thresh)
+{
+	return (u64) pkts_lost * 1024 > ((u64) pkts_acked + pkts_lost) * loss_thresh;
+}
+
+// The dual-horizon loss test on the packet counts of the short and the long
+// window
+static inline bool rocc_dual_loss_mode(u32 short_acked, u32 short_lost, u32 acked, u32 lost,
+				       u64 severe_thresh, u64 loss_thresh)
+{
+	return rocc_loss_mode(short_acked, short_lost, severe_thresh) ||
+		rocc_loss_mode(acked, lost, loss_thresh);
+}
+
+// The dual-horizon loss test on the windows over the short and long horizons
+static inline bool rocc_window_loss_mode(const struct rocc_window *short_w,
+					 const struct rocc_window *w,
+					 u64 severe_thresh, u64 loss_thresh)
+{
+	return rocc_dual_loss_mode(short_w->pkts_net_acked, short_w->pkts_net_lost,
+				   w->pkts_net_acked, w->pkts_net_lost, severe_thresh, loss_thresh);
+}
+
+/* May cwnd go down on this window? Not if most of its deliveries were
+ * app-limited. Otherwise a loss-triggered decrease (`decreased`) may, as the
+ * network-limited majority saw the losses. The increase rule may only if no
+ * delivery was app-limited: pkts_net_acked then understates what the path
+ * carried, and (cwnd + pkts_net_acked) / 2 would shrink cwnd for want of data
+ * rather than of capacity.
+ */
+static inline bool rocc_may_shrink(const struct rocc_window *w, bool decreased)
+{
+	if (w->app_limited)
+		return false;
+	return decreased || w->pkts_net_acked == w->pkts_acked;
+}
+
+// CCMATIC RULE
+/**
+ * if(Ld_f[0][t] > Ld_f[0][t-1]):
+ *     c_f[0][t] = max(0.01, 1/2v.c_f[0][t-1] + 0(S_f[0][t-1]-S_f[0][t-4]) + -1)
+ * else:
+ *     c_f[0][t] = max(0.01, 1/2v.c_f[0][t-1] + 1/2(S_f[0][t-1]-S_f[0][t-4]) + 1)
+*/
+
+// Multiplicative decrement, triggered on a unique loss event
+static inline u32 rocc_cwnd_decrease(u32 cwnd, u32 alpha)
+{
+	cwnd /= 2;
+	return cwnd > alpha ? cwnd - alpha : 0;
+}
+
+static inline u32 rocc_cwnd_increase(u32 cwnd, u32 pkts_acked, u32 alpha)
+{
+	return (cwnd + pkts_acked) / 2 + alpha;
+}
+
+// Pacing rate in bytes per second: one cwnd per min RTT
+static inline u64 rocc_pacing_rate(u32 cwnd, u32 mss, u32 min_rtt_us)
+{
+	return 1000000 * (u64) cwnd * mss / min_rtt_us;
+}
+
+#endif /* _TCP_ROCC_RULE_H */
@@ -0,0 +1,132 @@
+/* RoCC (Robust Congestion Control)
+ *
+ * Tracepoints. rocc_sample fires once per processed ACK; tools/rocctop
+ * attaches to it. rocc_pathology fires, rate-limited, when the pathology
+ * detector flags a flow.
+ */
+
+#ifndef _TCP_ROCC_TRACE_DEFS
+#define _TCP_ROCC_TRACE_DEFS
+
+enum rocc_pathology {
+	// At the minimum cwnd for rocc_patho_rounds min RTTs
+	ROCC_PATHO_MIN_CWND,
+	// cwnd range above 2x in each of rocc_patho_rounds min RTTs
+	ROCC_PATHO_OSCILLATION,
+	// Pacing rate off the delivery rate by rocc_patho_rate_ratio
+	ROCC_PATHO_RATE_MISMATCH,
+	// Two decreases less than a min RTT apart
+	ROCC_PATHO_REPEAT_DECREASE,
+	ROCC_NUM_PATHOLOGIES,
+};
+
+#endif /* _TCP_ROCC_TRACE_DEFS */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tcp_rocc
+
+#if !defined(_TCP_ROCC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TCP_ROCC_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <net/sock.h>
+
+// `decreased` is set when this ACK applied the decrease rule. Keep TP_PROTO
+// to plain arguments: BPF raw tracepoints see them as an array of u64 in this
+// order.
+TRACE_EVENT(rocc_sample,
+
+	TP_PROTO(const struct sock *sk, u32 cwnd, u64 pacing_rate, u32 min_rtt_us,
+		 u32 acked, u32 lost, bool loss_mode, bool app_limited, bool decreased),
+
+	TP_ARGS(sk, cwnd, pacing_rate, min_rtt_us, acked, lost, loss_mode, app_limited,
+		decreased),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(__u16, sport)
+		__field(__u16, dport)
+		__field(u32, cwnd)
+		__field(u64, pacing_rate)
+		__field(u32, min_rtt_us)
+		__field(u32, acked)
+		__field(u32, lost)
+		__field(bool, loss_mode)
+		__field(bool, app_limited)
+		__field(bool, decreased)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->sport = sk->sk_num;
+		__entry->dport = ntohs(sk->sk_dport);
+		__entry->cwnd = cwnd;
+		__entry->pacing_rate = pacing_rate;
+		__entry->min_rtt_us = min_rtt_us;
+		__entry->acked = acked;
+		__entry->lost = lost;
+		__entry->loss_mode = loss_mode;
+		__entry->app_limited = app_limited;
+		__entry->decreased = decreased;
+	),
+
+	TP_printk("skaddr=%p sport=%hu dport=%hu cwnd=%u pacing_rate=%llu min_rtt_us=%u acked=%u lost=%u loss_mode=%d app_limited=%d decreased=%d",
+		  __entry->skaddr, __entry->sport, __entry->dport, __entry->cwnd,
+		  __entry->pacing_rate, __entry->min_rtt_us, __entry->acked,
+		  __entry->lost, __entry->loss_mode, __entry->app_limited,
+		  __entry->decreased)
+);
+
+// Flow state when a pathology is detected. `rounds` is how many consecutive
+// min RTTs it lasted (0 for repeated decreases).
+TRACE_EVENT(rocc_pathology,
+
+	TP_PROTO(const struct sock *sk, int kind, u32 rounds, u32 cwnd, u64 pacing_rate,
+		 u64 delivery_rate, u32 min_rtt_us, u32 srtt_us),
+
+	TP_ARGS(sk, kind, rounds, cwnd, pacing_rate, delivery_rate, min_rtt_us, srtt_us),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(__u16, sport)
+		__field(__u16, dport)
+		__field(int, kind)
+		__field(u32, rounds)
+		__field(u32, cwnd)
+		__field(u64, pacing_rate)
+		__field(u64, delivery_rate)
+		__field(u32, min_rtt_us)
+		__field(u32, srtt_us)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->sport = sk->sk_num;
+		__entry->dport = ntohs(sk->sk_dport);
+		__entry->kind = kind;
+		__entry->rounds = rounds;
+		__entry->cwnd = cwnd;
+		__entry->pacing_rate = pacing_rate;
+		__entry->delivery_rate = delivery_rate;
+		__entry->min_rtt_us = min_rtt_us;
+		__entry->srtt_us = srtt_us;
+	),
+
+	TP_printk("skaddr=%p sport=%hu dport=%hu kind=%s rounds=%u cwnd=%u pacing_rate=%llu delivery_rate=%llu min_rtt_us=%u srtt_us=%u",
+		  __entry->skaddr, __entry->sport, __entry->dport,
+		  __print_symbolic(__entry->kind,
+				   { ROCC_PATHO_MIN_CWND, "min_cwnd" },
+				   { ROCC_PATHO_OSCILLATION, "oscillation" },
+				   { ROCC_PATHO_RATE_MISMATCH, "rate_mismatch" },
+				   { ROCC_PATHO_REPEAT_DECREASE, "repeat_decrease" }),
+		  __entry->rounds, __entry->cwnd, __entry->pacing_rate,
+		  __entry->delivery_rate, __entry->min_rtt_us, __entry->srtt_us)
+);
+
+#endif /* _TCP_ROCC_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tcp_rocc_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+# Benchmark result store and cross-build comparison.
+#
+# `record SCENARIO [ARGS...]` copies a scenario's output from stdin to stdout
+# and appends its results to the store, one JSON object per table row. A
+# table is a header line of column names followed by rows of values; the
+# first column names the variant (e.g. `loss_pct=1`), the others are metrics.
+# Each entry is keyed by the module's git revision, read from
+# /sys/module/tcp_rocc_ccmatic/version (set at build time), else from the
+# source tree. netns_bench.sh does this for every scenario run.
+#
+# `compare [BASE [NEW]]` pairs up the results of two revisions (default: the
+# last two recorded) by scenario, configuration, variant and metric. For each
+# it prints the mean of both, the relative change and its confidence interval
+# (Welch's t over repeated runs), and flags changes whose interval excludes
+# zero. Exits with 1 if any of them is a regression.
+#
+# The store is $ROCC_RESULTS, by default results.jsonl next to this script.
+#
+# Usage:
+#   bench_store.py record SCENARIO [ARGS...] < output
+#   bench_store.py compare [--scenario=S] [--confidence=C] [BASE [NEW]]
+
+import json
+import math
+import os
+import socket
+import subprocess
+import sys
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+STORE = os.environ.get('ROCC_RESULTS') or os.path.join(HERE, 'results.jsonl')
+MODULE_VERSION = '/sys/module/tcp_rocc_ccmatic/version'
+# Testbed settings that change results; runs are only compared if they match
+CONFIG_ENV = ('RATE', 'DELAY', 'DURATION', 'LIMIT', 'FLOWS', 'STEP_RATE',
+              'TCP_MEM', 'ACK_RATE', 'ACK_LOSS', 'DELAY_MS', 'SIZE', 'DEADLINE_MS',
+              'BG_FLOWS')
+
+# Metric name fragments, by direction of improvement. Others (counts,
+# thresholds) are reported but never flagged.
+HIGHER_BETTER = ('mbps', 'gain')
+LOWER_BETTER = ('retx', 'drops', 'rtt', 'recovery', 'cpu', 'cycles', 'fct',
+                'collapsed', 'pruned', 'loss', 'miss')
+
+
+def number(s):
+    try:
+        return float(s)
+    except ValueError:
+        return None
+
+
+def revision():
+    try:
+        with open(MODULE_VERSION) as f:
+            return f.read().strip()
+    except OSError:
+        pass
+    sys.stderr.write('bench_store: module has no version, using the source tree revision\n')
+    try:
+        return subprocess.run(['git', '-C', HERE, 'describe', '--always', '--dirty'],
+                              capture_output=True, text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return 'unknown'
+
+
+def record(scenario, args):
+    base = {
+        'rev': revision(),
+        'time': time.strftime('%Y-%m-%dT%H:%M:%S'),
+        'run': '%d-%d' % (time.time(), os.getpid()),
+        'host': socket.gethostname(),
+        'scenario': scenario,
+        'config': dict({k: os.environ[k] for k in CONFIG_ENV if k in os.environ},
+                       args=args),
+    }
+    header = None
+    entries = []
+    for line in sys.stdin:
+        sys.stdout.write(line)
+        sys.stdout.flush()
+        cols = line.split()
+        if not cols:
+            continue
+        values = [number(c) for c in cols[1:]]
+        if header is None or all(v is None for v in values):
+            header = cols
+            continue
+        if len(cols) != len(header):
+            continue
+        metrics = {h: v for h, v in zip(header[1:], values)
+                   if v is not None and not math.isnan(v)}
+        if metrics:
+            entries.append(dict(base, variant='%s=%s' % (header[0], cols[0]),
+                                metrics=metrics))
+    if entries:
+        with open(STORE, 'a') as f:
+            for e in entries:
+                f.write(json.dumps(e, sort_keys=True) + '\n')
+
+
+def betacf(a, b, x):
+    # Continued fraction for the incomplete beta function (Numerical Recipes)
+    qab, qap, qam = a + b, a + 1, a - 1
+    c, d = 1.0, 1 - qab * x / qap
+    d = 1 / (d if abs(d) > 1e-30 else 1e-30)
+    h = d
+    for m in range(1, 200):
+        m2 = 2 * m
+        for aa in (m * (b - m) * x / ((qam + m2) * (a + m2)),
+                   -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2))):
+            d = 1 + aa * d
+            d = 1 / (d if abs(d) > 1e-30 else 1e-30)
+            c = 1 + aa / c
+            c = c if abs(c) > 1e-30 else 1e-30
+            h *= d * c
+        if abs(d * c - 1) < 1e-12:
+            break
+    return h
+
+
+def betai(a, b, x):
+    if x <= 0 or x >= 1:
+        return 0.0 if x <= 0 else 1.0
+    bt = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) +
+                  a * math.log(x) + b * math.log(1 - x))
+    if x < (a + 1) / (a + b + 2):
+        return bt * betacf(a, b, x) / a
+    return 1 - bt * betacf(b, a, 1 - x) / b
+
+
+def t_quantile(p, df):
+    # Inverse of Student's t CDF for p > 0.5, by bisection
+    lo, hi = 0.0, 1e3
+    for _ in range(100):
+        mid = (lo + hi) / 2
+        if 1 - 0.5 * betai(df / 2, 0.5, df / (df + mid * mid)) < p:
+            lo = mid
+        else:
+            hi = mid
+    return (lo + hi) / 2
+
+
+def mean_var(v):
+    m = sum(v) / len(v)
+    return m, sum((x - m) ** 2 for x in v) / (len(v) - 1) if len(v) > 1 else 0.0
+
+
+def direction(metric):
+    if any(s in metric for s in HIGHER_BETTER):
+        return 1
+    if any(s in metric for s in LOWER_BETTER):
+        return -1
+    return 0
+
+
+def resolve(revs, prefix):
+    match = [r for r in revs if r.startswith(prefix)]
+    if len(match) != 1:
+        sys.exit('bench_store: %s matches %d recorded revisions' % (prefix, len(match)))
+    return match[0]
+
+
+def compare(argv):
+    confidence = 0.95
+    scenario = None
+    positional = []
+    for a in argv:
+        if a.startswith('--confidence='):
+            confidence = float(a.split('=', 1)[1])
+        elif a.startswith('--scenario='):
+            scenario = a.split('=', 1)[1]
+        else:
+            positional.append(a)
+
+    entries = []
+    with open(STORE) as f:
+        for line in f:
+            if line.strip():
+                entries.append(json.loads(line))
+    revs = []
+    for e in entries:
+        if e['rev'] not in revs:
+            revs.append(e['rev'])
+    if len(positional) >= 2:
+        base, new = resolve(revs, positional[0]), resolve(revs, positional[1])
+    elif len(positional) == 1:
+        base, new = resolve(revs, positional[0]), revs[-1]
+    elif len(revs) >= 2:
+        base, new = revs[-2], revs[-1]
+    else:
+        sys.exit('bench_store: need results from two revisions')
+
+    samples = {}
+    for e in entries:
+        if e['rev'] not in (base, new) or (scenario and e['scenario'] != scenario):
+            continue
+        cfg = ' '.join('%s=%s' % kv for kv in sorted(e['config'].items()) if kv[0] != 'args')
+        key = (e['scenario'], ' '.join(e['config'].get('args', [])), cfg, e['variant'])
+        for metric, v in e['metrics'].items():
+            samples.setdefault(key + (metric,), {}).setdefault(e['rev'], []).append(v)
+
+    print('base %s, new %s, %g%% confidence' % (base, new, 100 * confidence))
+    print('%-14s %-22s %-16s %12s %12s %9s %20s' % (
+        'scenario', 'variant', 'metric', 'base', 'new', 'delta%', 'ci%'))
+    regressions = 0
+    for key in sorted(samples):
+        s = samples[key]
+        if base not in s or new not in s:
+            continue
+        a, b = s[base], s[new]
+        ma, va = mean_var(a)
+        mb, vb = mean_var(b)
+        delta = mb - ma
+        scale = 100 / abs(ma) if ma else float('nan')
+        ci, flag = 'n/a', ''
+        if len(a) > 1 and len(b) > 1:
+            se2 = va / len(a) + vb / len(b)
+            if se2 > 0:
+                df = se2 ** 2 / ((va / len(a)) ** 2 / (len(a) - 1) +
+                                 (vb / len(b)) ** 2 / (len(b) - 1))
+                half = t_quantile(1 - (1 - confidence) / 2, df) * math.sqrt(se2)
+            else:
+                half = 0.0
+            ci = '[%+.1f, %+.1f]' % ((delta - half) * scale, (delta + half) * scale)
+            if abs(delta) > half:
+                d = direction(key[-1])
+                if d * delta < 0:
+                    flag = 'REGRESSION'
+                    regressions += 1
+                elif d * delta > 0:
+                    flag = 'improved'
+                else:
+                    flag = 'changed'
+        variant = key[3] + (' ' + key[1] if key[1] else '')
+        print('%-14s %-22s %-16s %7.2f (%2d) %7.2f (%2d) %+9.1f %20s %s' % (
+            key[0], variant, key[4], ma, len(a), mb, len(b), delta * scale, ci, flag))
+    return 1 if regressions else 0
+
+
+def main():
+    if len(sys.argv) >= 3 and sys.argv[1] == 'record':
+        record(sys.argv[2], sys.argv[3:])
+        return 0
+    if len(sys.argv) >= 2 and sys.argv[1] == 'compare':
+        return compare(sys.argv[2:])
+    sys.stderr.write('Usage: %s record SCENARIO [ARGS...] < output\n'
+                     '       %s compare [--scenario=S] [--confidence=C] [BASE [NEW]]\n'
+                     % (sys.argv[0], sys.argv[0]))
+    return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// Sockops program for netns_bench.sh `deadline`: gives every active TCP
+// connection in its cgroup a completion deadline of DEADLINE_US for
+// DEADLINE_BYTES through the module's bpf_rocc_set_deadline() kfunc.
+//
+// rocc_init() runs after the established callback, so the deadline is set on
+// the first RTT sample instead, about one RTT after the handshake. Build with
+// -DDEADLINE_US=... -DDEADLINE_BYTES=... against tools/vmlinux.h.
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+
+#ifndef DEADLINE_US
+#define DEADLINE_US 500000
+#endif
+#ifndef DEADLINE_BYTES
+#define DEADLINE_BYTES 1000000
+#endif
+
+extern int bpf_rocc_set_deadline(struct bpf_sock_ops_kern *skops, __u32 budget_us,
+				 __u64 remaining_bytes) __ksym;
+extern void *bpf_cast_to_kern_ctx(void *obj) __ksym;
+
+SEC("sockops")
+int rocc_deadline(struct bpf_sock_ops *skops)
+{
+	switch (skops->op) {
+	case BPF_SOCK_OPS_ACTIVE_ESTABLISHED_CB:
+		bpf_sock_ops_cb_flags_set(skops, BPF_SOCK_OPS_RTT_CB_FLAG);
+		break;
+	case BPF_SOCK_OPS_RTT_CB:
+		bpf_rocc_set_deadline(bpf_cast_to_kern_ctx(skops), DEADLINE_US, DEADLINE_BYTES);
+		bpf_sock_ops_cb_flags_set(skops, skops->bpf_sock_ops_cb_flags &
+					  ~BPF_SOCK_OPS_RTT_CB_FLAG);
+		break;
+	}
+	return 1;
+}
+
+char LICENSE[] SEC("license") = "GPL";
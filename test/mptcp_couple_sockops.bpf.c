@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// Sockops program for netns_bench.sh `mptcp`: couples the subflows of each
+// MPTCP connection in its cgroup through the module's bpf_rocc_couple()
+// kfunc, keyed on the connection's token. Plain TCP sockets are left alone.
+//
+// rocc_init() runs after the established callback, so subflows join on their
+// first RTT sample instead. Build against tools/vmlinux.h.
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+
+extern int bpf_rocc_couple(struct bpf_sock_ops_kern *skops, __u32 key) __ksym;
+extern void *bpf_cast_to_kern_ctx(void *obj) __ksym;
+
+SEC("sockops")
+int rocc_mptcp_couple(struct bpf_sock_ops *skops)
+{
+	struct mptcp_sock *msk;
+	struct bpf_sock *sk;
+
+	switch (skops->op) {
+	case BPF_SOCK_OPS_ACTIVE_ESTABLISHED_CB:
+		bpf_sock_ops_cb_flags_set(skops, BPF_SOCK_OPS_RTT_CB_FLAG);
+		break;
+	case BPF_SOCK_OPS_RTT_CB:
+		sk = skops->sk;
+		if (!sk)
+			break;
+		msk = bpf_skc_to_mptcp_sock(sk);
+		if (msk)
+			bpf_rocc_couple(bpf_cast_to_kern_ctx(skops), msk->token);
+		bpf_sock_ops_cb_flags_set(skops, skops->bpf_sock_ops_cb_flags &
+					  ~BPF_SOCK_OPS_RTT_CB_FLAG);
+		break;
+	}
+	return 1;
+}
+
+char LICENSE[] SEC("license") = "GPL";
@@ -0,0 +1,442 @@
+#!/bin/bash
+# Network namespace testbed for RoCC benchmarks.
+#
+# Creates two namespaces, rocc_snd and rocc_rcv, connected by a veth pair. The
+# bottleneck (rate, delay, loss, ...) is configured on the sender side with
+# netem. Flows are generated with iperf3, which must be installed, and the
+# module must already be loaded.
+#
+# Scenario results are also appended to the result store (bench_store.py,
+# $ROCC_RESULTS; set it empty to skip). REPEAT=N runs the scenario N times,
+# for `bench_store.py compare`.
+
+cmd=$1
+snd=rocc_snd
+rcv=rocc_rcv
+snd_ip=10.200.0.1
+rcv_ip=10.200.0.2
+port=5201
+cc=rocc_ccmatic
+params=/sys/module/tcp_rocc_ccmatic/parameters
+debugfs=/sys/kernel/debug/tcp_rocc_ccmatic
+
+rate=${RATE:-100mbit}
+delay=${DELAY:-20ms}
+duration=${DURATION:-20}
+
+store=${ROCC_RESULTS-$(dirname "$0")/results.jsonl}
+if [[ -n $store && -z $ROCC_STORING && $cmd != "setup" && $cmd != "teardown" ]]; then
+    for i in $(seq 1 ${REPEAT:-1}); do
+        # Per-ACK cost is measured over the whole run, see the end of this script
+        [[ $(cat $params/rocc_prof_every 2> /dev/null || echo 0) != 0 ]] && echo | sudo tee $debugfs/profile > /dev/null
+        ROCC_STORING=1 bash "$0" "$@" | ROCC_RESULTS=$store python3 "$(dirname "$0")/bench_store.py" record "$@"
+        [[ ${PIPESTATUS[0]} != 0 ]] && exit 1
+    done
+    exit 0
+fi
+
+setup() {
+    sudo ip netns add $snd
+    sudo ip netns add $rcv
+    sudo ip link add veth_snd netns $snd type veth peer name veth_rcv netns $rcv
+    sudo ip -n $snd addr add $snd_ip/24 dev veth_snd
+    sudo ip -n $rcv addr add $rcv_ip/24 dev veth_rcv
+    sudo ip -n $snd link set veth_snd up
+    sudo ip -n $rcv link set veth_rcv up
+    sudo ip -n $snd link set lo up
+    sudo ip -n $rcv link set lo up
+    sudo ip netns exec $snd sysctl -q net.ipv4.tcp_allowed_congestion_control="reno cubic $cc"
+}
+
+teardown() {
+    sudo ip netns del $snd 2> /dev/null
+    sudo ip netns del $rcv 2> /dev/null
+}
+
+# Set the sender side bottleneck. Extra arguments are appended to netem,
+# e.g. `link loss 1%`
+link() {
+    sudo ip netns exec $snd tc qdisc replace dev veth_snd root netem \
+        rate $rate delay $delay limit ${LIMIT:-1000} "$@"
+}
+
+set_param() {
+    echo $2 | sudo tee $params/$1 > /dev/null
+}
+
+# Run `$2` parallel flows with module parameter `$1` set to 0 and then 1.
+# Prints the throughput (Mbit/s) and retransmits of both runs and the
+# throughput gain
+compare_param() {
+    set_param $1 0
+    local off=$(run_flows ${2:-1})
+    set_param $1 1
+    local on=$(run_flows ${2:-1})
+    echo "$off $on $(python3 -c "print('%.2f' % (${on% *} / max(${off% *}, 0.01)))")"
+}
+
+# Run `$1` parallel flows and print the aggregate throughput in Mbit/s
+run_flows() {
+    local flows=${1:-1}
+    # MPTCPIZE=1 runs iperf3 over MPTCP
+    local wrap=""
+    [[ -n $MPTCPIZE ]] && wrap="mptcpize run"
+    sudo ip netns exec $rcv $wrap iperf3 -s -1 -D -p $port > /dev/null
+    sleep 0.5
+    sudo ip netns exec $snd $wrap iperf3 -c $rcv_ip -p $port -C $cc -P $flows \
+         -t $duration -J | python3 -c '
+import json, sys
+r = json.load(sys.stdin)["end"]["sum_sent"]
+print("%.2f %d" % (r["bits_per_second"] / 1e6, r.get("retransmits", 0)))'
+}
+
+if [[ $cmd = "setup" ]]; then
+    setup
+elif [[ $cmd = "teardown" ]]; then
+    teardown
+elif [[ $cmd = "loss_sweep" ]]; then
+    # Throughput under random loss with and without the loss classifier
+    echo "loss_pct off_mbps off_retx on_mbps on_retx gain"
+    for loss in 0 0.1 0.5 1 2 5 10; do
+        link loss ${loss}%
+        echo "$loss $(compare_param rocc_loss_classify)"
+    done
+    set_param rocc_loss_classify 0
+elif [[ $cmd = "reorder" ]]; then
+    # Throughput under reordering (no real loss) with and without discounting
+    # losses that DSACK later shows were spurious
+    echo "reorder_pct off_mbps off_retx on_mbps on_retx gain"
+    for reorder in 0 1 5 10 25; do
+        link reorder ${reorder}% 50%
+        echo "$reorder $(compare_param rocc_undo_spurious)"
+    done
+elif [[ $cmd = "mem_pressure" ]]; then
+    # Many flows under a tight tcp_mem limit. Reports throughput, retransmits
+    # and the increase in the receiver's TCP collapse/prune counters.
+    flows=${2:-64}
+    link
+    # tcp_mem is global and only visible in the init netns. Restore it on
+    # any exit, including an interrupted run.
+    old_mem=$(sudo sysctl -n net.ipv4.tcp_mem) || exit 1
+    trap 'sudo sysctl -q net.ipv4.tcp_mem="$old_mem"' EXIT
+    trap 'exit 130' INT TERM
+    sudo sysctl -q net.ipv4.tcp_mem="${TCP_MEM:-2048 4096 8192}"
+    echo "mem_pressure mbps retx collapsed pruned"
+    for on in 0 1; do
+        set_param rocc_mem_pressure $on
+        before=$(sudo ip netns exec $rcv nstat -az TcpExtTCPRcvCollapsed TcpExtPruneCalled | awk 'NR>1 {print $2}')
+        res=$(run_flows $flows)
+        after=$(sudo ip netns exec $rcv nstat -az TcpExtTCPRcvCollapsed TcpExtPruneCalled | awk 'NR>1 {print $2}')
+        echo "$on $res $(paste <(echo "$after") <(echo "$before") | awk '{printf "%d ", $1 - $2}')"
+    done
+elif [[ $cmd = "mptcp" ]]; then
+    # MPTCP over two paths. A single-path TCP flow competes on path 1. With
+    # coupling the MPTCP connection should take a single flow's share there
+    # and shift its load to path 2. mptcp_couple_sockops.bpf.c couples the
+    # subflows of each connection in its cgroup. Needs clang, bpftool and
+    # Linux >= 6.15.
+    cg=/sys/fs/cgroup/rocc_mptcp
+    pin=/sys/fs/bpf/rocc_mptcp
+    orig_cg=/sys/fs/cgroup$(sed -n 's/^0:://p' /proc/self/cgroup)
+    make -s -C "$(dirname "$0")/../tools" vmlinux.h
+    clang -g -O2 -target bpf -I "$(dirname "$0")/../tools" \
+        -c "$(dirname "$0")/mptcp_couple_sockops.bpf.c" -o /tmp/rocc_mptcp.o
+    sudo mkdir -p $cg
+    sudo ip link add veth_snd2 netns $snd type veth peer name veth_rcv2 netns $rcv
+    sudo ip -n $snd addr add 10.201.0.1/24 dev veth_snd2
+    sudo ip -n $rcv addr add 10.201.0.2/24 dev veth_rcv2
+    sudo ip -n $snd link set veth_snd2 up
+    sudo ip -n $rcv link set veth_rcv2 up
+    sudo ip netns exec $snd tc qdisc replace dev veth_snd2 root netem \
+        rate $rate delay $delay limit ${LIMIT:-1000}
+    link
+    for ns in $snd $rcv; do
+        sudo ip netns exec $ns sysctl -q net.mptcp.enabled=1
+        sudo ip -n $ns mptcp limits set subflow 2 add_addr_accepted 2
+    done
+    sudo ip -n $snd mptcp endpoint add 10.201.0.1 dev veth_snd2 subflow
+    sudo ip -n $rcv mptcp endpoint add 10.201.0.2 dev veth_rcv2 signal
+    echo "coupled mptcp_mbps mptcp_retx tcp_mbps tcp_retx"
+    for on in 0 1; do
+        if [[ $on = 1 ]]; then
+            sudo bpftool prog load /tmp/rocc_mptcp.o $pin type sockops
+            sudo bpftool cgroup attach $cg sock_ops pinned $pin
+            # Flows started from here on run in $cg
+            echo $$ | sudo tee $cg/cgroup.procs > /dev/null
+        fi
+        sudo ip netns exec $rcv iperf3 -s -1 -D -p $((port + 1)) > /dev/null
+        sudo ip netns exec $snd iperf3 -c $rcv_ip -p $((port + 1)) -C $cc \
+             -t $duration -J > /tmp/rocc_tcp.json &
+        res=$(MPTCPIZE=1 run_flows 1)
+        wait
+        echo "$on $res $(python3 -c '
+import json
+r = json.load(open("/tmp/rocc_tcp.json"))["end"]["sum_sent"]
+print("%.2f %d" % (r["bits_per_second"] / 1e6, r.get("retransmits", 0)))')"
+        if [[ $on = 1 ]]; then
+            echo $$ | sudo tee $orig_cg/cgroup.procs > /dev/null
+            sudo bpftool cgroup detach $cg sock_ops pinned $pin
+            sudo rm -f $pin
+        fi
+    done
+    sudo rmdir $cg
+    sudo ip -n $snd link del veth_snd2
+elif [[ $cmd = "step_change" ]]; then
+    # Bottleneck drops from $rate to ${STEP_RATE:-10mbit} halfway through the
+    # run. Recovery is the time from the step until a 0.5 s interval has
+    # fewer than 10 retransmits and at least 80% of the new rate.
+    step_rate=${STEP_RATE:-10mbit}
+    echo "severe_thresh mbps retx recovery_s"
+    for thresh in 256 1024; do
+        set_param rocc_severe_loss_thresh $thresh
+        link
+        sudo ip netns exec $rcv iperf3 -s -1 -D -p $port > /dev/null
+        sleep 0.5
+        sudo ip netns exec $snd iperf3 -c $rcv_ip -p $port -C $cc -t $duration \
+             -i 0.5 -J > /tmp/rocc_step.json &
+        sleep $((duration / 2))
+        sudo ip netns exec $snd tc qdisc change dev veth_snd root netem \
+            rate $step_rate delay $delay limit ${LIMIT:-1000}
+        wait
+        echo "$thresh $(STEP_AT=$((duration / 2)) STEP_MBPS=${step_rate%mbit} python3 -c '
+import json, os
+r = json.load(open("/tmp/rocc_step.json"))
+step, target = float(os.environ["STEP_AT"]), float(os.environ["STEP_MBPS"])
+s = r["end"]["sum_sent"]
+recovery = float("nan")
+for i in r["intervals"]:
+    iv = i["sum"]
+    if iv["start"] >= step and iv.get("retransmits", 0) < 10 and \
+            iv["bits_per_second"] >= 0.8 * target * 1e6:
+        recovery = iv["start"] - step
+        break
+print("%.2f %d %.1f" % (s["bits_per_second"] / 1e6, s.get("retransmits", 0), recovery))')"
+    done
+    set_param rocc_severe_loss_thresh 256
+elif [[ $cmd = "bdp_cap" ]]; then
+    # Deep buffer (LIMIT packets). RTT is sampled from `ss` every 100 ms
+    # while the flow runs; queueing delay is RTT minus the base delay.
+    LIMIT=${LIMIT:-20000} link
+    echo "cap_gain mbps retx rtt_p50_ms rtt_p90_ms rtt_p99_ms"
+    for gain in 0 2048; do
+        set_param rocc_bdp_cap_gain $gain
+        rm -f /tmp/rocc_rtt.txt
+        (
+            sleep 1
+            for i in $(seq 1 $(((duration - 2) * 10))); do
+                sudo ip netns exec $snd ss -tin dst $rcv_ip | grep -o " rtt:[0-9.]*" | cut -d: -f2
+                sleep 0.1
+            done > /tmp/rocc_rtt.txt
+        ) &
+        res=$(run_flows 1)
+        wait
+        echo "$gain $res $(python3 -c '
+v = sorted(float(x) for x in open("/tmp/rocc_rtt.txt") if x.strip())
+p = lambda q: v[min(len(v) - 1, int(q * len(v)))] if v else float("nan")
+print("%.1f %.1f %.1f" % (p(0.5), p(0.9), p(0.99)))')"
+    done
+    set_param rocc_bdp_cap_gain 0
+elif [[ $cmd = "host_budget" ]]; then
+    # Many flows from one host. iperf3 runs at most 128 streams per client,
+    # so larger counts are split over several clients.
+    flows=${2:-256}
+    budget=$(python3 -c "print(int(${rate%mbit} * 0.95))")
+    link
+    echo "budget_mbps mbps retx"
+    for b in 0 $budget; do
+        set_param rocc_host_budget_mbps $b
+        clients=$(((flows + 127) / 128))
+        for c in $(seq 0 $((clients - 1))); do
+            sudo ip netns exec $rcv iperf3 -s -1 -D -p $((port + 10 + c)) > /dev/null
+        done
+        sleep 0.5
+        for c in $(seq 0 $((clients - 1))); do
+            sudo ip netns exec $snd iperf3 -c $rcv_ip -p $((port + 10 + c)) -C $cc \
+                 -P $(((flows - 128 * c) < 128 ? flows - 128 * c : 128)) \
+                 -t $duration -J > /tmp/rocc_budget_$c.json &
+        done
+        wait
+        echo "$b $(python3 -c '
+import glob, json
+bps = retx = 0
+for f in glob.glob("/tmp/rocc_budget_*.json"):
+    s = json.load(open(f))["end"]["sum_sent"]
+    bps += s["bits_per_second"]
+    retx += s.get("retransmits", 0)
+print("%.2f %d" % (bps / 1e6, retx))')"
+        rm -f /tmp/rocc_budget_*.json
+    done
+    set_param rocc_host_budget_mbps 0
+elif [[ $cmd = "linkem" ]]; then
+    # RoCC over tools/rocc_linkem replaying delivery traces. The host is the
+    # sender, namespace rocc_lem the receiver. Extra arguments go to the
+    # emulator, e.g. `linkem up.tr down.tr --queue-pkts=200 --aqm=codel`.
+    up_trace=$2
+    down_trace=$3
+    lem=rocc_lem
+    linkem="$(dirname "$0")/../tools/rocc_linkem"
+    sudo $linkem --delay-ms=${DELAY_MS:-10} "${@:4}" $up_trace $down_trace &
+    lem_pid=$!
+    sleep 0.5
+    sudo ip netns add $lem
+    sudo ip link set linkem1 netns $lem
+    sudo ip addr add 10.64.0.1/24 dev linkem0
+    sudo ip link set linkem0 up
+    sudo ip route add 10.65.0.0/24 dev linkem0
+    sudo ip -n $lem addr add 10.65.0.2/24 dev linkem1
+    sudo ip -n $lem link set linkem1 up
+    sudo ip -n $lem link set lo up
+    sudo ip -n $lem route add 10.64.0.0/24 dev linkem1
+    sudo ip netns exec $lem iperf3 -s -1 -D -p $port > /dev/null
+    sleep 0.5
+    echo "mbps retx"
+    iperf3 -c 10.65.0.2 -p $port -C $cc -P ${FLOWS:-1} -t $duration -J | python3 -c '
+import json, sys
+r = json.load(sys.stdin)["end"]["sum_sent"]
+print("%.2f %d" % (r["bits_per_second"] / 1e6, r.get("retransmits", 0)))'
+    sudo kill -INT $lem_pid
+    wait $lem_pid
+    sudo ip netns del $lem
+elif [[ $cmd = "loss_autotune" ]]; then
+    # Fixed against auto-tuned loss threshold on a clean link, a link with
+    # 2% random loss and a congested link (8 flows, 100 packet buffer), then
+    # the histogram of auto-tuned thresholds (debugfs loss_thresh).
+    echo "scenario off_mbps off_retx on_mbps on_retx gain"
+    link
+    echo "clean $(compare_param rocc_loss_autotune)"
+    link loss 2%
+    echo "lossy $(compare_param rocc_loss_autotune)"
+    LIMIT=100 link
+    echo "congested $(compare_param rocc_loss_autotune 8)"
+    set_param rocc_loss_autotune 0
+    echo "thresh count"
+    sudo cat /sys/kernel/debug/tcp_rocc_ccmatic/loss_thresh
+elif [[ $cmd = "ack_starve" ]]; then
+    # Congested, lossy reverse path: ACKs are squeezed through
+    # ${ACK_RATE:-1mbit} with ${ACK_LOSS:-10%} loss. Reports throughput,
+    # retransmits and packets dropped at the forward bottleneck, with and
+    # without the pacing decay on ACK gaps.
+    sudo ip netns exec $rcv tc qdisc replace dev veth_rcv root netem \
+        rate ${ACK_RATE:-1mbit} delay $delay loss ${ACK_LOSS:-10%} limit ${LIMIT:-1000}
+    echo "starve_rtts mbps retx fwd_drops"
+    for rtts in 0 4; do
+        set_param rocc_starve_rtts $rtts
+        # Recreate the bottleneck to reset its drop counter
+        sudo ip netns exec $snd tc qdisc del dev veth_snd root 2> /dev/null
+        link
+        res=$(run_flows 1)
+        echo "$rtts $res $(sudo ip netns exec $snd tc -s qdisc show dev veth_snd | grep -o 'dropped [0-9]*' | head -1 | cut -d' ' -f2)"
+    done
+    sudo ip netns exec $rcv tc qdisc del dev veth_rcv root
+    set_param rocc_starve_rtts 4
+elif [[ $cmd = "loopback" ]]; then
+    # Flows over lo inside $snd, with and without the loopback fast path.
+    # Reports throughput and the sender's CPU utilisation.
+    echo "fastpath mbps retx cpu_pct"
+    for on in 0 1; do
+        set_param rocc_local_fastpath $on
+        sudo ip netns exec $snd iperf3 -s -1 -D -p $port > /dev/null
+        sleep 0.5
+        sudo ip netns exec $snd iperf3 -c 127.0.0.1 -p $port -C $cc -P ${2:-1} \
+             -t $duration -J | python3 -c '
+import json, sys
+r = json.load(sys.stdin)["end"]
+s = r["sum_sent"]
+print("%.2f %d %.1f" % (s["bits_per_second"] / 1e6, s.get("retransmits", 0),
+                        r["cpu_utilization_percent"]["host_total"]))' | sed "s/^/$on /"
+    done
+    set_param rocc_local_fastpath 1
+elif [[ $cmd = "fct" ]]; then
+    # Flow completion time of single transfers on an idle bottleneck, ${2:-10}
+    # of each size
+    link
+    echo "size_bytes fct_p50_ms fct_p99_ms"
+    for size in 10K 100K 1M 10M; do
+        for i in $(seq 1 ${2:-10}); do
+            sudo ip netns exec $rcv iperf3 -s -1 -D -p $port > /dev/null
+            sleep 0.2
+            sudo ip netns exec $snd iperf3 -c $rcv_ip -p $port -C $cc -n $size -J |
+                python3 -c 'import json, sys; print(json.load(sys.stdin)["end"]["sum_sent"]["seconds"] * 1e3)'
+        done | SIZE=$(numfmt --from=iec $size) python3 -c '
+import os, sys
+v = sorted(float(x) for x in sys.stdin if x.strip())
+p = lambda q: v[min(len(v) - 1, int(q * len(v)))] if v else float("nan")
+print("%s %.1f %.1f" % (os.environ["SIZE"], p(0.5), p(0.99)))'
+    done
+elif [[ $cmd = "deadline" ]]; then
+    # ${2:-20} sequential ${SIZE:-1M} transfers with a ${DEADLINE_MS:-500} ms
+    # deadline, each competing with ${BG_FLOWS:-4} bulk flows, with and
+    # without the deadline hint. deadline_sockops.bpf.c sets it on the
+    # transfers' cgroup. Needs clang and bpftool.
+    size=$(numfmt --from=iec ${SIZE:-1M})
+    deadline_ms=${DEADLINE_MS:-500}
+    cg=/sys/fs/cgroup/rocc_deadline
+    pin=/sys/fs/bpf/rocc_deadline
+    make -s -C "$(dirname "$0")/../tools" vmlinux.h
+    clang -g -O2 -target bpf -I "$(dirname "$0")/../tools" -DDEADLINE_US=$((deadline_ms * 1000)) \
+        -DDEADLINE_BYTES=$size -c "$(dirname "$0")/deadline_sockops.bpf.c" -o /tmp/rocc_deadline.o
+    sudo mkdir -p $cg
+    link
+    echo "deadline fct_p50_ms fct_p99_ms miss_pct"
+    for on in 0 1; do
+        if [[ $on = 1 ]]; then
+            sudo bpftool prog load /tmp/rocc_deadline.o $pin type sockops
+            sudo bpftool cgroup attach $cg sock_ops pinned $pin
+        fi
+        sudo ip netns exec $rcv iperf3 -s -1 -D -p $((port + 1)) > /dev/null
+        sleep 0.5
+        sudo ip netns exec $snd iperf3 -c $rcv_ip -p $((port + 1)) -C $cc -P ${BG_FLOWS:-4} \
+             -t $duration > /dev/null &
+        sleep 2
+        for i in $(seq 1 ${2:-20}); do
+            sudo ip netns exec $rcv iperf3 -s -1 -D -p $port > /dev/null
+            sleep 0.2
+            sudo sh -c "echo \$\$ > $cg/cgroup.procs && exec ip netns exec $snd \
+                iperf3 -c $rcv_ip -p $port -C $cc -n $size -J" |
+                python3 -c 'import json, sys; print(json.load(sys.stdin)["end"]["sum_sent"]["seconds"] * 1e3)'
+        done | DEADLINE_MS=$deadline_ms python3 -c '
+import os, sys
+v = sorted(float(x) for x in sys.stdin if x.strip())
+p = lambda q: v[min(len(v) - 1, int(q * len(v)))] if v else float("nan")
+miss = sum(x > float(os.environ["DEADLINE_MS"]) for x in v)
+print("%.1f %.1f %.1f" % (p(0.5), p(0.99), 100 * miss / max(len(v), 1)))' | sed "s/^/$on /"
+        sudo pkill -INT -f "iperf3 -c $rcv_ip -p $((port + 1))"
+        wait
+        if [[ $on = 1 ]]; then
+            sudo bpftool cgroup detach $cg sock_ops pinned $pin
+            sudo rm -f $pin
+        fi
+    done
+    sudo rmdir $cg
+elif [[ $cmd = "repair" ]]; then
+    # A loopback flow migrated with TCP_REPAIR halfway through, with and
+    # without restoring RoCC's state. lo in $snd is the bottleneck, so the
+    # loopback fast path is turned off.
+    set_param rocc_local_fastpath 0
+    sudo ip netns exec $snd tc qdisc replace dev lo root netem \
+        rate $rate delay $delay limit ${LIMIT:-1000}
+    echo "restore before_mbps after_0_500ms_mbps after_500_1000ms_mbps"
+    for restore in "" --restore; do
+        sudo ip netns exec $snd python3 "$(dirname "$0")/repair_migrate.py" $restore $duration
+    done
+    sudo ip netns exec $snd tc qdisc del dev lo root
+    set_param rocc_local_fastpath 1
+else
+    echo "Invalid command $cmd. Please use one of the following commands:"
+    echo "setup, teardown, loss_sweep, reorder, mem_pressure, mptcp, step_change, bdp_cap, host_budget, linkem, repair, ack_starve, loopback, loss_autotune, fct, deadline"
+    exit 1
+fi
+
+# Mean cycles per sampled ACK on each code path (rocc_prof_every), for the
+# result store
+if [[ -n $ROCC_STORING && $(cat $params/rocc_prof_every 2> /dev/null || echo 0) != 0 ]]; then
+    echo "path cycles_per_ack"
+    sudo cat $debugfs/profile | python3 -c '
+import sys
+for line in sys.stdin:
+    path, *buckets = line.split()
+    n = sum(int(b.split(":")[1]) for b in buckets)
+    # Bucket k counts calls of k to 2k cycles
+    c = sum(1.5 * int(b.split(":")[0]) * int(b.split(":")[1]) for b in buckets)
+    print("%s %.0f" % (path, c / max(n, 1)))'
+fi
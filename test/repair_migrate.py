@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+# Migrate a sending RoCC socket with TCP_REPAIR on loopback and measure the
+# throughput dip.
+#
+# A bulk flow runs over lo (give lo a netem bottleneck first, see
+# netns_bench.sh `repair`). Halfway through, the sender drains its send queue,
+# dumps the socket in repair mode, closes it silently and restores it on a new
+# socket, as CRIU does. With --restore, RoCC's state is read with TCP_CC_INFO
+# and TCP_INFO and written to the module's debugfs `restore` file first.
+#
+# Prints the throughput (Mbit/s) over the second before the migration and over
+# the first and second 500 ms after it. Must run as root.
+#
+# Usage:
+#   repair_migrate.py [--restore] [SECONDS]
+
+import fcntl
+import socket
+import struct
+import sys
+import threading
+import time
+
+TCP_CONGESTION = getattr(socket, 'TCP_CONGESTION', 13)
+TCP_INFO = 11
+TCP_REPAIR = 19
+TCP_REPAIR_QUEUE = 20
+TCP_QUEUE_SEQ = 21
+TCP_REPAIR_OPTIONS = 22
+TCP_TIMESTAMP = 24
+TCP_CC_INFO = 26
+TCP_REPAIR_WINDOW = 29
+TCP_RECV_QUEUE = 1
+TCP_SEND_QUEUE = 2
+TCPOPT_MAXSEG = 2
+TCPOPT_WINDOW = 3
+TCPOPT_SACK_PERM = 4
+TCPOPT_TIMESTAMP = 8
+TCPI_OPT_TIMESTAMPS = 1
+TCPI_OPT_SACK = 2
+TCPI_OPT_WSCALE = 4
+SIOCOUTQ = 0x5411
+
+RESTORE = '/sys/kernel/debug/tcp_rocc_ccmatic/restore'
+ADDR = '127.0.0.1'
+PORT = 5301
+BIN = 0.1
+
+restore = '--restore' in sys.argv
+args = [a for a in sys.argv[1:] if a != '--restore']
+seconds = float(args[0]) if args else 10
+
+# Bytes received in each BIN-second bin
+bins = []
+
+
+def receive(listener):
+    conn, _ = listener.accept()
+    start = time.monotonic()
+    while True:
+        data = conn.recv(1 << 20)
+        if not data:
+            break
+        i = int((time.monotonic() - start) / BIN)
+        bins.extend([0] * (i + 1 - len(bins)))
+        bins[i] += len(data)
+
+
+def dump(s):
+    s.setsockopt(socket.IPPROTO_TCP, TCP_REPAIR, 1)
+    state = {'local': s.getsockname(), 'peer': s.getpeername()}
+    for q in (TCP_SEND_QUEUE, TCP_RECV_QUEUE):
+        s.setsockopt(socket.IPPROTO_TCP, TCP_REPAIR_QUEUE, q)
+        state[q] = struct.unpack('I', s.getsockopt(socket.IPPROTO_TCP, TCP_QUEUE_SEQ, 4))[0]
+    state['window'] = s.getsockopt(socket.IPPROTO_TCP, TCP_REPAIR_WINDOW, 20)
+    state['ts'] = s.getsockopt(socket.IPPROTO_TCP, TCP_TIMESTAMP, 4)
+    info = s.getsockopt(socket.IPPROTO_TCP, TCP_INFO, 104)
+    options, wscale = info[5], info[6]
+    state['mss'] = struct.unpack_from('I', info, 16)[0]
+    state['cwnd'] = struct.unpack_from('I', info, 80)[0]
+    state['options'] = [(TCPOPT_MAXSEG, state['mss'])]
+    if options & TCPI_OPT_WSCALE:
+        state['options'].append((TCPOPT_WINDOW, (wscale & 0xf) | (wscale >> 4) << 16))
+    if options & TCPI_OPT_SACK:
+        state['options'].append((TCPOPT_SACK_PERM, 0))
+    if options & TCPI_OPT_TIMESTAMPS:
+        state['options'].append((TCPOPT_TIMESTAMP, 0))
+    bw_lo, bw_hi, min_rtt, _, _ = struct.unpack(
+        'IIIII', s.getsockopt(socket.IPPROTO_TCP, TCP_CC_INFO, 20))
+    state['min_rtt'] = min_rtt
+    state['bw'] = bw_hi << 32 | bw_lo
+    # Closing in repair mode sends neither FIN nor RST
+    s.close()
+    return state
+
+
+def restore_socket(state):
+    if restore:
+        with open(RESTORE, 'w') as f:
+            f.write('%s %d %s %d %d %d %d\n' % (
+                state['local'] + state['peer'] +
+                (state['min_rtt'], state['cwnd'], state['bw'])))
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.setsockopt(socket.IPPROTO_TCP, TCP_REPAIR, 1)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.setsockopt(socket.IPPROTO_TCP, TCP_CONGESTION, b'rocc_ccmatic')
+    for q in (TCP_SEND_QUEUE, TCP_RECV_QUEUE):
+        s.setsockopt(socket.IPPROTO_TCP, TCP_REPAIR_QUEUE, q)
+        s.setsockopt(socket.IPPROTO_TCP, TCP_QUEUE_SEQ, struct.pack('I', state[q]))
+    s.bind(state['local'])
+    s.connect(state['peer'])
+    s.setsockopt(socket.IPPROTO_TCP, TCP_REPAIR_OPTIONS,
+                 b''.join(struct.pack('II', *o) for o in state['options']))
+    s.setsockopt(socket.IPPROTO_TCP, TCP_TIMESTAMP, state['ts'])
+    s.setsockopt(socket.IPPROTO_TCP, TCP_REPAIR_WINDOW, state['window'])
+    s.setsockopt(socket.IPPROTO_TCP, TCP_REPAIR, 0)
+    return s
+
+
+def send_for(s, until):
+    msg = b'.' * (1 << 16)
+    while time.monotonic() < until:
+        s.send(msg)
+
+
+listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+listener.bind((ADDR, PORT))
+listener.listen(1)
+receiver = threading.Thread(target=receive, args=(listener,))
+receiver.start()
+
+s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+s.setsockopt(socket.IPPROTO_TCP, TCP_CONGESTION, b'rocc_ccmatic')
+s.connect((ADDR, PORT))
+start = time.monotonic()
+send_for(s, start + seconds / 2)
+# Migrate with an empty send queue, so that no data has to be carried over
+while struct.unpack('I', fcntl.ioctl(s, SIOCOUTQ, b'\0' * 4))[0]:
+    time.sleep(0.001)
+migrated = time.monotonic() - start
+s = restore_socket(dump(s))
+send_for(s, start + seconds)
+s.close()
+receiver.join()
+
+
+def mbps(t0, t1):
+    b = bins[max(0, int(t0 / BIN)):max(0, int(t1 / BIN))]
+    return sum(b) * 8 / 1e6 / max(len(b) * BIN, BIN)
+
+
+print('%d %.2f %.2f %.2f' % (restore, mbps(migrated - 1, migrated),
+                             mbps(migrated, migrated + 0.5),
+                             mbps(migrated + 0.5, migrated + 1)))
@@ -0,0 +1,107 @@
+// Delivery-opportunity traces, as used by Mahimahi
+//
+// A trace lists the times, in milliseconds, at which the link can deliver one
+// MTU-sized packet. It repeats with a period equal to its last timestamp.
+//
+// Traces are stored either as Mahimahi text (one timestamp per line) or in a
+// compact binary form: the magic "RDT1", a little-endian u64 count, then the
+// differences between consecutive timestamps as LEB128 varints.
+
+#ifndef DELIVERY_TRACE_HPP
+#define DELIVERY_TRACE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class DeliveryTrace {
+ public:
+  DeliveryTrace() = default;
+  explicit DeliveryTrace(std::vector<uint64_t> ms) : ms_(std::move(ms)) {
+    if (ms_.empty() || ms_.back() == 0)
+      throw std::runtime_error("trace must contain a non-zero timestamp");
+  }
+
+  // Read a trace in either format
+  static DeliveryTrace load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open trace " + path);
+    char magic[4] = {};
+    in.read(magic, sizeof(magic));
+    if (in && std::memcmp(magic, kMagic, sizeof(magic)) == 0) return load_binary(in, path);
+    in.clear();
+    in.seekg(0);
+
+    // Mahimahi text: one non-decreasing millisecond timestamp per line
+    std::vector<uint64_t> ms;
+    uint64_t t;
+    while (in >> t) {
+      if (!ms.empty() && t < ms.back())
+        throw std::runtime_error("trace " + path + " is not sorted");
+      ms.push_back(t);
+    }
+    return DeliveryTrace(std::move(ms));
+  }
+
+  void save(const std::string& path) const {
+    std::ofstream out(path);
+    for (uint64_t t : ms_) out << t << '\n';
+    if (!out) throw std::runtime_error("cannot write trace " + path);
+  }
+
+  void save_binary(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    out.write(kMagic, 4);
+    uint64_t n = ms_.size();
+    for (int i = 0; i < 8; ++i) out.put(static_cast<char>(n >> (8 * i)));
+    uint64_t prev = 0;
+    for (uint64_t t : ms_) {
+      uint64_t d = t - prev;
+      prev = t;
+      do {
+        out.put(static_cast<char>((d & 0x7f) | (d > 0x7f ? 0x80 : 0)));
+        d >>= 7;
+      } while (d);
+    }
+    if (!out) throw std::runtime_error("cannot write trace " + path);
+  }
+
+  // Time of the i-th delivery opportunity, in microseconds from the start
+  uint64_t opportunity_us(uint64_t i) const {
+    return ((i / ms_.size()) * ms_.back() + ms_[i % ms_.size()]) * 1000;
+  }
+
+  const std::vector<uint64_t>& ms() const { return ms_; }
+
+ private:
+  static constexpr char kMagic[4] = {'R', 'D', 'T', '1'};
+
+  static DeliveryTrace load_binary(std::ifstream& in, const std::string& path) {
+    uint64_t n = 0;
+    for (int i = 0; i < 8; ++i) n |= static_cast<uint64_t>(static_cast<uint8_t>(in.get())) << (8 * i);
+    if (!in) throw std::runtime_error("truncated trace " + path);
+    std::vector<uint64_t> ms;
+    ms.reserve(n);
+    uint64_t t = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      uint64_t d = 0;
+      int c;
+      for (int shift = 0;; shift += 7) {
+        c = in.get();
+        if (c == EOF || shift > 63) throw std::runtime_error("truncated trace " + path);
+        d |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if (!(c & 0x80)) break;
+      }
+      t += d;
+      ms.push_back(t);
+    }
+    return DeliveryTrace(std::move(ms));
+  }
+
+  std::vector<uint64_t> ms_;
+};
+
+#endif  // DELIVERY_TRACE_HPP
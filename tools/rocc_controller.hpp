@@ -0,0 +1,133 @@
+// RoCC (Robust Congestion Control) for userspace transports
+//
+// Header-only wrapper around the rule in tcp_rocc_rule.h, which the kernel
+// module uses as well. No allocation; the history lives inline.
+//
+// Like the module with its default parameters, the controller applies the
+// dual-horizon loss test, discounts losses reported as spurious
+// (AckSample::spurious, the module's rocc_undo_spurious), never shrinks cwnd
+// for want of data (rocc_may_shrink) and keeps cwnd at or above a floor (the
+// policy profile's min_cwnd). It does not have the module's other
+// modifiers: restoring cwnd when the stack undoes a loss episode, the pacing
+// cut when ACKs stop arriving (rocc_starve_rtts), the socket memory pressure
+// freeze, the loopback fast path, and everything off by default (random loss
+// classifier, loss threshold autotuning, deadlines, coupling, BDP cap, host
+// budget, profiles other than min_cwnd).
+
+#ifndef ROCC_CONTROLLER_HPP
+#define ROCC_CONTROLLER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "../tcp_rocc_rule.h"
+
+namespace rocc {
+
+// Clock reading CLOCK_MONOTONIC in microseconds
+struct MonotonicClock {
+  static uint64_t now_us();
+};
+
+// One ACK's worth of feedback, the userspace equivalent of the kernel's
+// `struct rate_sample`
+template <typename Seq>
+struct AckSample {
+  uint32_t acked = 0;
+  uint32_t lost = 0;
+  // RTT of this sample, 0 if none
+  uint32_t rtt_us = 0;
+  bool app_limited = false;
+  // Packets reported lost earlier that turned out not to be, e.g. DSACKed
+  // retransmissions in TCP or late ACKs of packets declared lost in QUIC
+  uint32_t spurious = 0;
+  // Highest sequence/packet number newly acked by this ACK
+  Seq last_end_seq = 0;
+};
+
+// Clock: type with a static `uint64_t now_us()`
+// Seq: sequence/packet number type, e.g. uint32_t for TCP, uint64_t for QUIC
+// Depth: number of history intervals, a power of two
+template <typename Clock = MonotonicClock, typename Seq = uint64_t,
+          std::size_t Depth = 16>
+class Controller {
+  static_assert(Depth >= 2 && (Depth & (Depth - 1)) == 0,
+                "Depth must be a power of two");
+  static_assert(Depth <= 0x10000, "Depth must fit in u16");
+  static_assert(std::is_unsigned<Seq>::value, "Seq must be unsigned");
+  static constexpr u16 kMask = static_cast<u16>(Depth - 1);
+
+ public:
+  // `next_seq` is the next sequence number to be sent. As in the kernel,
+  // assume a decrease just happened at connection setup. cwnd never goes
+  // below `min_cwnd` packets.
+  explicit Controller(uint32_t mss, Seq next_seq = 0, uint32_t min_cwnd = rocc_min_cwnd)
+      : mss_(mss), min_cwnd_(min_cwnd), last_decrease_seq_(next_seq) {
+    rocc_hist_reset(intervals_.data(), kMask);
+  }
+
+  // Process one ACK. `srtt_us` is the smoothed RTT (0 if unknown) and
+  // `next_seq` the next sequence number to be sent.
+  void on_ack(const AckSample<Seq>& s, uint32_t srtt_us, Seq next_seq) {
+    const uint64_t now = Clock::now_us();
+    if (srtt_us != 0 && srtt_us < min_rtt_us_) min_rtt_us_ = srtt_us;
+    const u32 hist_us = rocc_hist_us(min_rtt_us_);
+
+    if (s.spurious) rocc_hist_discount(intervals_.data(), kMask, head_, s.spurious);
+    rocc_hist_update(intervals_.data(), kMask, &head_, now, hist_us, s.acked,
+                     s.lost, s.rtt_us ? s.rtt_us : U32_MAX, s.app_limited);
+    rocc_window w, short_w;
+    rocc_hist_window(intervals_.data(), kMask, head_, now, hist_us, &w);
+    rocc_hist_window(intervals_.data(), kMask, head_, now,
+                     rocc_short_hist_us(min_rtt_us_, ROCC_SHORT_HIST_MULT, hist_us), &short_w);
+
+    u32 cwnd;
+    bool decreased = false;
+    if (rocc_window_loss_mode(&short_w, &w, ROCC_SEVERE_LOSS_THRESH, rocc_loss_thresh) &&
+        after(s.last_end_seq, last_decrease_seq_)) {
+      last_decrease_seq_ = next_seq;
+      decreased = true;
+      cwnd = rocc_cwnd_decrease(cwnd_, rocc_alpha);
+    } else {
+      cwnd = rocc_cwnd_increase(cwnd_, w.pkts_net_acked, rocc_alpha);
+    }
+    // Do not decrease cwnd for want of data
+    if (cwnd < cwnd_ && !rocc_may_shrink(&w, decreased)) cwnd = cwnd_;
+    cwnd_ = cwnd > min_cwnd_ ? cwnd : min_cwnd_;
+    pacing_rate_ = rocc_pacing_rate(cwnd_, mss_, min_rtt_us_);
+  }
+
+  uint32_t cwnd() const { return cwnd_; }
+  // Bytes per second
+  uint64_t pacing_rate() const { return pacing_rate_; }
+  uint32_t min_rtt_us() const { return min_rtt_us_; }
+
+ private:
+  // Wrap-around safe `a > b`, like the kernel's after()
+  static bool after(Seq a, Seq b) {
+    return static_cast<typename std::make_signed<Seq>::type>(b - a) < 0;
+  }
+
+  std::array<rocc_interval, Depth> intervals_;
+  u16 head_ = 0;
+  uint32_t mss_;
+  uint32_t min_cwnd_;
+  uint32_t cwnd_ = 10;
+  uint32_t min_rtt_us_ = U32_MAX;
+  uint64_t pacing_rate_ = 0;
+  Seq last_decrease_seq_;
+};
+
+}  // namespace rocc
+
+#include <time.h>
+
+inline uint64_t rocc::MonotonicClock::now_us() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif  // ROCC_CONTROLLER_HPP
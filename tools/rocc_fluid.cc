@@ -0,0 +1,199 @@
+// Fluid model of one RoCC flow through a single bottleneck
+//
+// Time advances in fixed ticks (a fraction of the base RTT). Each tick the
+// flow sends cwnd/RTT worth of packets into a FIFO of capacity --mbps with a
+// --buffer-pkts buffer; packets that do not fit are lost. Deliveries and
+// losses reach the sender one base RTT later and drive the same rule code as
+// the kernel module (tcp_rocc_rule.h), through the sender shared with
+// rocc_ensemble (rocc_fluid.hpp). Random loss is binomial; --mean-loss drops
+// its expected value instead, as rocc_ensemble does, to reproduce an
+// ensemble configuration.
+//
+// Prints steady-state utilisation, queueing delay and loss rate after
+// --warmup-rtts, and the simulation speed.
+//
+// Usage:
+//   rocc_fluid [options]
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "rocc_fluid.hpp"
+
+namespace {
+
+constexpr double kMss = 1448;
+
+struct Options {
+  double mbps = 100;
+  double rtt_ms = 20;
+  // Bottleneck buffer, in packets. Negative means one BDP.
+  double buffer_pkts = -1;
+  // Random (non-congestive) loss probability
+  double loss = 0;
+  // Drop the expected random loss instead of a binomial draw
+  bool mean_loss = false;
+  int ticks_per_rtt = 8;
+  uint64_t rtts = 100000;
+  uint64_t warmup_rtts = 1000;
+  uint64_t seed = 1;
+};
+
+struct Result {
+  double utilisation = 0;
+  double qdelay_ms = 0;
+  double loss_rate = 0;
+  double mean_cwnd = 0;
+  uint64_t steps = 0;
+};
+
+// In flight feedback: what one tick delivered and lost, and the highest
+// sequence number (cumulative packets sent) it acknowledges
+struct Feedback {
+  double delivered;
+  double lost;
+  uint32_t rtt_us;
+  uint32_t end_seq;
+};
+
+Result run(const Options& opt) {
+  const double capacity = opt.mbps * 1e6 / 8 / kMss;  // packets per second
+  const double base_rtt = opt.rtt_ms / 1000;
+  const double dt = base_rtt / opt.ticks_per_rtt;
+  const double buffer =
+      opt.buffer_pkts < 0 ? capacity * base_rtt : opt.buffer_pkts;
+  const uint64_t dt_us = static_cast<uint64_t>(dt * 1e6);
+  std::mt19937_64 rng(opt.seed);
+  std::binomial_distribution<uint32_t> random_loss;
+
+  // Feedback in flight, one base RTT long
+  std::vector<Feedback> pipe(opt.ticks_per_rtt, Feedback{0, 0, U32_MAX, 0});
+  size_t pipe_pos = 0;
+
+  rocc::FluidSender snd;
+  double queue = 0;
+  double sent_total = 0;
+
+  Result r;
+  double delivered_sum = 0, lost_sum = 0, sent_sum = 0, qdelay_sum = 0, cwnd_sum = 0;
+  const uint64_t ticks = opt.rtts * opt.ticks_per_rtt;
+  const uint64_t warmup = opt.warmup_rtts * opt.ticks_per_rtt;
+
+  for (uint64_t tick = 0; tick < ticks; ++tick) {
+    const uint64_t now_us = (tick + 1) * dt_us;
+    // Send: one window per current RTT, bounded by the pacing rate of
+    // one window per min RTT
+    const double rtt = base_rtt + queue / capacity;
+    const double sent = snd.cwnd * dt / rtt;
+    queue += sent;
+    sent_total += sent;
+    const double departed = std::min(queue, capacity * dt);
+    queue -= departed;
+    double lost = 0;
+    if (queue > buffer) {
+      lost = queue - buffer;
+      queue = buffer;
+    }
+    double delivered = departed;
+    if (opt.mean_loss) {
+      delivered -= departed * opt.loss;
+      lost += departed * opt.loss;
+    } else if (opt.loss > 0 && departed >= 1) {
+      random_loss.param(std::binomial_distribution<uint32_t>::param_type(
+          static_cast<uint32_t>(departed), opt.loss));
+      const double l = random_loss(rng);
+      delivered -= l;
+      lost += l;
+    }
+
+    if (tick >= warmup) {
+      delivered_sum += delivered;
+      lost_sum += lost;
+      sent_sum += sent;
+      qdelay_sum += queue / capacity;
+      cwnd_sum += snd.cwnd;
+    }
+
+    // Feedback for what was sent one base RTT ago arrives now
+    Feedback fb = pipe[pipe_pos];
+    pipe[pipe_pos] = {delivered, lost, static_cast<u32>(rtt * 1e6),
+                      static_cast<u32>(sent_total)};
+    pipe_pos = (pipe_pos + 1) % pipe.size();
+    if (fb.rtt_us == U32_MAX) continue;
+
+    snd.on_feedback(now_us, fb.delivered, fb.lost, fb.rtt_us, fb.end_seq,
+                    static_cast<u32>(sent_total));
+    ++r.steps;
+  }
+
+  const double measured = static_cast<double>(ticks - warmup);
+  r.utilisation = delivered_sum / (capacity * dt * measured);
+  r.qdelay_ms = qdelay_sum / measured * 1000;
+  r.loss_rate = sent_sum > 0 ? lost_sum / sent_sum : 0;
+  r.mean_cwnd = cwnd_sum / measured;
+  return r;
+}
+
+void usage(const char* prog) {
+  std::fprintf(stderr,
+               "Usage: %s [options]\n"
+               "  --mbps=R           bottleneck rate (default 100)\n"
+               "  --rtt-ms=R         base RTT (default 20)\n"
+               "  --buffer-pkts=N    buffer size, default one BDP\n"
+               "  --loss=P           random loss probability (default 0)\n"
+               "  --mean-loss        drop the expected random loss, as rocc_ensemble\n"
+               "  --ticks-per-rtt=N  time resolution (default 8)\n"
+               "  --rtts=N           simulated RTTs (default 100000)\n"
+               "  --warmup-rtts=N    RTTs excluded from the results (default 1000)\n"
+               "  --seed=N           random seed (default 1)\n",
+               prog);
+}
+
+bool parse_opt(const char* arg, const char* name, std::string* value) {
+  size_t n = std::strlen(name);
+  if (std::strncmp(arg, name, n) != 0 || arg[n] != '=') return false;
+  *value = arg + n + 1;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string v;
+    if (parse_opt(argv[i], "--mbps", &v)) opt.mbps = std::stod(v);
+    else if (parse_opt(argv[i], "--rtt-ms", &v)) opt.rtt_ms = std::stod(v);
+    else if (parse_opt(argv[i], "--buffer-pkts", &v)) opt.buffer_pkts = std::stod(v);
+    else if (parse_opt(argv[i], "--loss", &v)) opt.loss = std::stod(v);
+    else if (!std::strcmp(argv[i], "--mean-loss")) opt.mean_loss = true;
+    else if (parse_opt(argv[i], "--ticks-per-rtt", &v)) opt.ticks_per_rtt = std::stoi(v);
+    else if (parse_opt(argv[i], "--rtts", &v)) opt.rtts = std::stoull(v);
+    else if (parse_opt(argv[i], "--warmup-rtts", &v)) opt.warmup_rtts = std::stoull(v);
+    else if (parse_opt(argv[i], "--seed", &v)) opt.seed = std::stoull(v);
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (opt.mbps <= 0 || opt.rtt_ms <= 0 || opt.ticks_per_rtt < 1 || opt.warmup_rtts >= opt.rtts) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const Result r = run(opt);
+  const double secs =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::printf("utilisation %.4f qdelay_ms %.3f loss_rate %.5f mean_cwnd %.1f\n",
+              r.utilisation, r.qdelay_ms, r.loss_rate, r.mean_cwnd);
+  std::printf("%llu steps in %.3f ms (%.1f M steps/s)\n",
+              static_cast<unsigned long long>(r.steps), secs * 1000, r.steps / secs / 1e6);
+  return 0;
+}
@@ -0,0 +1,72 @@
+// Sender side of the RoCC fluid model, shared by rocc_fluid and rocc_ensemble
+//
+// The fluid link delivers and drops fractional packets each tick. The sender
+// turns the feedback of one tick into whole packets (carrying the fractions
+// over) and runs the rule of tcp_rocc_rule.h on it: interval history, the
+// dual-horizon loss test, the CCmatic update and rocc_may_shrink().
+
+#ifndef ROCC_FLUID_HPP
+#define ROCC_FLUID_HPP
+
+#include <cstdint>
+
+#include "../tcp_rocc_rule.h"
+
+namespace rocc {
+
+// The kernel applies the increase once per ACK. The fluid models apply it
+// once per delivered packet, at most this many times per tick.
+constexpr u32 kFluidMaxIncreasesPerTick = 32;
+
+struct FluidSender {
+  rocc_interval intervals[rocc_num_intervals];
+  u16 head = 0;
+  u32 cwnd = 10;
+  u32 min_rtt_us = U32_MAX;
+  u32 last_decrease_seq = 0;
+  // Fractional deliveries and losses carried to the next tick
+  double acked_carry = 0, lost_carry = 0;
+
+  FluidSender() { rocc_hist_reset(intervals, rocc_num_intervals_mask); }
+
+  // Feedback from one tick of the link arriving at `now_us`: packets
+  // delivered and lost, the RTT they saw and the highest sequence number
+  // (cumulative packets sent) they acknowledge. `next_seq` is the sequence
+  // number of the next packet to send.
+  void on_feedback(uint64_t now_us, double delivered, double lost, u32 rtt_us,
+                   u32 end_seq, u32 next_seq) {
+    acked_carry += delivered;
+    lost_carry += lost;
+    const u32 acked = static_cast<u32>(acked_carry);
+    const u32 lost_pkts = static_cast<u32>(lost_carry);
+    acked_carry -= acked;
+    lost_carry -= lost_pkts;
+
+    if (rtt_us < min_rtt_us) min_rtt_us = rtt_us;
+    const u32 hist_us = rocc_hist_us(min_rtt_us);
+    rocc_hist_update(intervals, rocc_num_intervals_mask, &head, now_us, hist_us, acked,
+                     lost_pkts, rtt_us, false);
+    rocc_window w, short_w;
+    rocc_hist_window(intervals, rocc_num_intervals_mask, head, now_us, hist_us, &w);
+    rocc_hist_window(intervals, rocc_num_intervals_mask, head, now_us,
+                     rocc_short_hist_us(min_rtt_us, ROCC_SHORT_HIST_MULT, hist_us), &short_w);
+
+    u32 next = cwnd;
+    bool decreased = false;
+    if (rocc_window_loss_mode(&short_w, &w, ROCC_SEVERE_LOSS_THRESH, rocc_loss_thresh) &&
+        static_cast<int32_t>(end_seq - last_decrease_seq) > 0) {
+      last_decrease_seq = next_seq;
+      decreased = true;
+      next = rocc_cwnd_decrease(cwnd, rocc_alpha);
+    } else {
+      for (u32 i = 0; i < acked && i < kFluidMaxIncreasesPerTick; ++i)
+        next = rocc_cwnd_increase(next, w.pkts_net_acked, rocc_alpha);
+    }
+    if (next < cwnd && !rocc_may_shrink(&w, decreased)) next = cwnd;
+    cwnd = next > rocc_min_cwnd ? next : rocc_min_cwnd;
+  }
+};
+
+}  // namespace rocc
+
+#endif  // ROCC_FLUID_HPP
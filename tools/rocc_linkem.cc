@@ -0,0 +1,406 @@
+// Trace-driven link emulator on TUN devices
+//
+// Replays Mahimahi-format delivery traces between two TUN devices, one per
+// side of the emulated link. Packets read from the first device cross the
+// uplink and are written to the second; packets read from the second cross
+// the downlink and are written to the first. Each direction runs in its own
+// thread with its own packet pool, so the hot path takes no locks.
+//
+// Usage:
+//   rocc_linkem [options] UPLINK_TRACE DOWNLINK_TRACE
+//
+// Move the second device into another network namespace to put the link
+// between two network stacks (see `linkem` in test/netns_bench.sh).
+
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "delivery_trace.hpp"
+
+namespace {
+
+constexpr size_t kMaxPacket = 2048;
+// Bytes a single delivery opportunity can carry, as in Mahimahi
+constexpr uint32_t kOpportunityBytes = 1504;
+// Packets read from or written to a device per wakeup
+constexpr int kBatch = 64;
+// Packets that can be in the delay line (or queued, without a packet limit).
+// Reading stops when the pool runs out, and the TUN device drops instead.
+constexpr uint32_t kInFlightPackets = 16384;
+
+volatile sig_atomic_t g_stop = 0;
+
+uint64_t now_us() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+enum class Aqm { kDropTail, kCoDel };
+
+struct Options {
+  std::string dev[2] = {"linkem0", "linkem1"};
+  // Queue limit in packets (0 = unlimited) and bytes (0 = unlimited)
+  uint32_t queue_pkts = 1000;
+  uint64_t queue_bytes = 0;
+  Aqm aqm = Aqm::kDropTail;
+  // CoDel parameters
+  uint64_t codel_target_us = 5000;
+  uint64_t codel_interval_us = 100000;
+  // Random loss probability applied on enqueue
+  double loss = 0;
+  // Extra one-way propagation delay
+  uint64_t delay_us = 0;
+  uint64_t seed = 1;
+  // Spin instead of sleeping between events, for multi-Gbit/s rates
+  bool busy = false;
+};
+
+// Fixed pool of packet buffers, recycled through a free list. Packets are
+// read into, queued in and written from the same buffer.
+class PacketPool {
+ public:
+  explicit PacketPool(size_t n) : data_(n * kMaxPacket), len_(n) {
+    free_.reserve(n);
+    for (size_t i = n; i > 0; --i) free_.push_back(static_cast<uint32_t>(i - 1));
+  }
+  bool empty() const { return free_.empty(); }
+  uint32_t get() {
+    uint32_t i = free_.back();
+    free_.pop_back();
+    return i;
+  }
+  void put(uint32_t i) { free_.push_back(i); }
+  uint8_t* buf(uint32_t i) { return &data_[static_cast<size_t>(i) * kMaxPacket]; }
+  uint32_t& len(uint32_t i) { return len_[i]; }
+
+ private:
+  std::vector<uint8_t> data_;
+  std::vector<uint32_t> len_;
+  std::vector<uint32_t> free_;
+};
+
+// FIFO of pool indices with their enqueue time
+class PacketQueue {
+ public:
+  explicit PacketQueue(size_t capacity) : ring_(capacity) {}
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == ring_.size(); }
+  size_t size() const { return size_; }
+  void push(uint32_t pkt, uint64_t t) {
+    ring_[(head_ + size_) % ring_.size()] = {pkt, t};
+    ++size_;
+  }
+  uint32_t front() const { return ring_[head_].pkt; }
+  uint64_t front_time() const { return ring_[head_].t; }
+  void pop() {
+    head_ = (head_ + 1) % ring_.size();
+    --size_;
+  }
+
+ private:
+  struct Entry {
+    uint32_t pkt;
+    uint64_t t;
+  };
+  std::vector<Entry> ring_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+
+struct Stats {
+  uint64_t rx_pkts = 0;
+  uint64_t tx_pkts = 0;
+  uint64_t tx_bytes = 0;
+  uint64_t drops = 0;
+  uint64_t losses = 0;
+};
+
+// One direction of the link: read from `in`, emulate, write to `out`
+class Link {
+ public:
+  Link(const Options& opt, int in, int out, DeliveryTrace trace)
+      : opt_(opt),
+        in_(in),
+        out_(out),
+        trace_(std::move(trace)),
+        pool_(opt.queue_pkts + kInFlightPackets),
+        queue_(opt.queue_pkts + kInFlightPackets),
+        delay_line_(opt.queue_pkts + kInFlightPackets),
+        rng_(opt.seed ^ static_cast<uint64_t>(in)) {}
+
+  void run() {
+    start_us_ = now_us();
+    next_opportunity_us_ = start_us_ + trace_.opportunity_us(0);
+    pollfd pfd = {in_, POLLIN, 0};
+    while (!g_stop) {
+      uint64_t now = now_us();
+      dequeue(now);
+      flush_delay_line(now);
+
+      int timeout_ms = 0;
+      if (!opt_.busy) {
+        uint64_t next = next_event_us();
+        timeout_ms = next == UINT64_MAX ? 100
+                     : next <= now      ? 0
+                                        : static_cast<int>((next - now) / 1000);
+      }
+      if (poll(&pfd, 1, timeout_ms) > 0) enqueue(now_us());
+    }
+  }
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  uint64_t next_event_us() const {
+    uint64_t next = UINT64_MAX;
+    if (!queue_.empty()) next = next_opportunity_us_;
+    if (!delay_line_.empty()) next = std::min(next, delay_line_.front_time());
+    return next;
+  }
+
+  // Drain up to kBatch packets from the device into the queue
+  void enqueue(uint64_t now) {
+    std::uniform_real_distribution<double> coin(0, 1);
+    for (int i = 0; i < kBatch && !pool_.empty(); ++i) {
+      uint32_t pkt = pool_.get();
+      ssize_t n = read(in_, pool_.buf(pkt), kMaxPacket);
+      if (n <= 0) {
+        pool_.put(pkt);
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+          // The device went away, e.g. its namespace was deleted
+          perror("read");
+          g_stop = 1;
+        }
+        return;
+      }
+      ++stats_.rx_pkts;
+      pool_.len(pkt) = static_cast<uint32_t>(n);
+      if (opt_.loss > 0 && coin(rng_) < opt_.loss) {
+        ++stats_.losses;
+        pool_.put(pkt);
+      } else if (queue_.full() || (opt_.queue_pkts && queue_.size() >= opt_.queue_pkts) ||
+                 (opt_.queue_bytes && queued_bytes_ + n > opt_.queue_bytes)) {
+        ++stats_.drops;
+        pool_.put(pkt);
+      } else {
+        queued_bytes_ += n;
+        queue_.push(pkt, now);
+      }
+    }
+  }
+
+  // Use every delivery opportunity that has passed. As in Mahimahi,
+  // opportunities are wasted while the queue is empty.
+  void dequeue(uint64_t now) {
+    while (next_opportunity_us_ <= now) {
+      uint32_t budget = kOpportunityBytes + carry_bytes_;
+      carry_bytes_ = 0;
+      while (!queue_.empty()) {
+        uint32_t pkt = queue_.front();
+        if (opt_.aqm == Aqm::kCoDel && codel_drop(pkt, next_opportunity_us_)) continue;
+        if (pool_.len(pkt) > budget) {
+          // Large packets accumulate the budget of consecutive opportunities
+          carry_bytes_ = budget;
+          break;
+        }
+        budget -= pool_.len(pkt);
+        queue_.pop();
+        queued_bytes_ -= pool_.len(pkt);
+        delay_line_.push(pkt, next_opportunity_us_ + opt_.delay_us);
+      }
+      next_opportunity_us_ = start_us_ + trace_.opportunity_us(++opportunity_);
+    }
+  }
+
+  // CoDel (RFC 8289) drop decision for the packet at the head of the queue.
+  // Pops and frees it if dropped.
+  bool codel_drop(uint32_t pkt, uint64_t now) {
+    uint64_t sojourn = now - queue_.front_time();
+    bool ok_to_drop = false;
+    if (sojourn < opt_.codel_target_us || queued_bytes_ <= kOpportunityBytes) {
+      first_above_time_ = 0;
+    } else if (first_above_time_ == 0) {
+      first_above_time_ = now + opt_.codel_interval_us;
+    } else if (now >= first_above_time_) {
+      ok_to_drop = true;
+    }
+
+    if (dropping_) {
+      if (!ok_to_drop) {
+        dropping_ = false;
+        return false;
+      }
+      if (now < drop_next_) return false;
+      ++drop_count_;
+    } else {
+      if (!ok_to_drop) return false;
+      dropping_ = true;
+      drop_count_ = drop_count_ > 2 && now - drop_next_ < 16 * opt_.codel_interval_us
+                        ? drop_count_ - 2
+                        : 1;
+    }
+    drop_next_ = now + static_cast<uint64_t>(opt_.codel_interval_us / std::sqrt(drop_count_));
+    queue_.pop();
+    queued_bytes_ -= pool_.len(pkt);
+    pool_.put(pkt);
+    ++stats_.drops;
+    return true;
+  }
+
+  // Write packets whose propagation delay has elapsed
+  void flush_delay_line(uint64_t now) {
+    for (int i = 0; i < kBatch && !delay_line_.empty(); ++i) {
+      if (delay_line_.front_time() > now) return;
+      uint32_t pkt = delay_line_.front();
+      delay_line_.pop();
+      if (write(out_, pool_.buf(pkt), pool_.len(pkt)) > 0) {
+        ++stats_.tx_pkts;
+        stats_.tx_bytes += pool_.len(pkt);
+      }
+      pool_.put(pkt);
+    }
+  }
+
+  const Options& opt_;
+  int in_, out_;
+  DeliveryTrace trace_;
+  PacketPool pool_;
+  PacketQueue queue_;
+  PacketQueue delay_line_;
+  std::mt19937_64 rng_;
+  Stats stats_;
+
+  uint64_t start_us_ = 0;
+  uint64_t opportunity_ = 0;
+  uint64_t next_opportunity_us_ = 0;
+  uint32_t carry_bytes_ = 0;
+  uint64_t queued_bytes_ = 0;
+
+  // CoDel state
+  uint64_t first_above_time_ = 0;
+  uint64_t drop_next_ = 0;
+  uint32_t drop_count_ = 0;
+  bool dropping_ = false;
+};
+
+int tun_open(const std::string& name) {
+  int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) throw std::runtime_error("open /dev/net/tun: " + std::string(strerror(errno)));
+  ifreq ifr = {};
+  ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+  std::strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+  if (ioctl(fd, TUNSETIFF, &ifr) < 0)
+    throw std::runtime_error("TUNSETIFF " + name + ": " + strerror(errno));
+  return fd;
+}
+
+void usage(const char* prog) {
+  std::fprintf(stderr,
+               "Usage: %s [options] UPLINK_TRACE DOWNLINK_TRACE\n"
+               "  --dev0=NAME          first TUN device (default linkem0)\n"
+               "  --dev1=NAME          second TUN device (default linkem1)\n"
+               "  --queue-pkts=N       queue limit in packets, 0 = none (default 1000)\n"
+               "  --queue-bytes=N      queue limit in bytes, 0 = none (default 0)\n"
+               "  --aqm=droptail|codel queue management (default droptail)\n"
+               "  --codel-target-us=N  CoDel target (default 5000)\n"
+               "  --codel-interval-us=N CoDel interval (default 100000)\n"
+               "  --loss=P             random loss probability (default 0)\n"
+               "  --delay-ms=N         extra one-way delay (default 0)\n"
+               "  --seed=N             random seed (default 1)\n"
+               "  --busy               busy-poll instead of sleeping\n"
+               "Traces are Mahimahi text or rocc_tracegen binary files.\n",
+               prog);
+}
+
+bool parse_opt(const char* arg, const char* name, std::string* value) {
+  size_t n = std::strlen(name);
+  if (std::strncmp(arg, name, n) != 0 || arg[n] != '=') return false;
+  *value = arg + n + 1;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  std::vector<std::string> traces;
+  for (int i = 1; i < argc; ++i) {
+    std::string v;
+    if (parse_opt(argv[i], "--dev0", &v)) opt.dev[0] = v;
+    else if (parse_opt(argv[i], "--dev1", &v)) opt.dev[1] = v;
+    else if (parse_opt(argv[i], "--queue-pkts", &v)) opt.queue_pkts = std::stoul(v);
+    else if (parse_opt(argv[i], "--queue-bytes", &v)) opt.queue_bytes = std::stoull(v);
+    else if (parse_opt(argv[i], "--codel-target-us", &v)) opt.codel_target_us = std::stoull(v);
+    else if (parse_opt(argv[i], "--codel-interval-us", &v)) opt.codel_interval_us = std::stoull(v);
+    else if (parse_opt(argv[i], "--loss", &v)) opt.loss = std::stod(v);
+    else if (parse_opt(argv[i], "--delay-ms", &v)) opt.delay_us = std::stoull(v) * 1000;
+    else if (parse_opt(argv[i], "--seed", &v)) opt.seed = std::stoull(v);
+    else if (parse_opt(argv[i], "--aqm", &v)) {
+      if (v == "droptail") opt.aqm = Aqm::kDropTail;
+      else if (v == "codel") opt.aqm = Aqm::kCoDel;
+      else {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--busy") == 0) opt.busy = true;
+    else if (argv[i][0] == '-') {
+      usage(argv[0]);
+      return 1;
+    } else traces.push_back(argv[i]);
+  }
+  if (traces.size() != 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    int fd0 = tun_open(opt.dev[0]);
+    int fd1 = tun_open(opt.dev[1]);
+    Link up(opt, fd0, fd1, DeliveryTrace::load(traces[0]));
+    Link down(opt, fd1, fd0, DeliveryTrace::load(traces[1]));
+
+    struct sigaction sa = {};
+    sa.sa_handler = [](int) { g_stop = 1; };
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::thread t([&] { down.run(); });
+    up.run();
+    t.join();
+
+    const char* names[2] = {"uplink", "downlink"};
+    const Stats* stats[2] = {&up.stats(), &down.stats()};
+    for (int i = 0; i < 2; ++i) {
+      std::printf("%s rx %llu tx %llu tx_bytes %llu drops %llu losses %llu\n", names[i],
+                  static_cast<unsigned long long>(stats[i]->rx_pkts),
+                  static_cast<unsigned long long>(stats[i]->tx_pkts),
+                  static_cast<unsigned long long>(stats[i]->tx_bytes),
+                  static_cast<unsigned long long>(stats[i]->drops),
+                  static_cast<unsigned long long>(stats[i]->losses));
+    }
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "rocc_linkem: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,41 @@
+// Measures the per-ACK cost of the userspace RoCC controller
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "rocc_controller.hpp"
+
+namespace {
+
+// Simulated clock so that the benchmark measures the rule, not clock_gettime
+struct FakeClock {
+  static uint64_t t;
+  static uint64_t now_us() { return t; }
+};
+uint64_t FakeClock::t = 0;
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const long n = argc > 1 ? std::atol(argv[1]) : 100000000;
+  rocc::Controller<FakeClock, uint64_t, 16> c(1448);
+  rocc::AckSample<uint64_t> s;
+  uint64_t seq = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < n; ++i) {
+    FakeClock::t += 10;
+    s.acked = 1;
+    s.lost = (i & 63) == 0;
+    s.rtt_us = 10000 + (i & 1023);
+    s.last_end_seq = seq;
+    seq += 1;
+    c.on_ack(s, 10000, seq + c.cwnd());
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  std::printf("%ld acks %.2f ns/ack final cwnd %u pacing %llu\n", n, ns / n,
+              c.cwnd(), static_cast<unsigned long long>(c.pacing_rate()));
+  return 0;
+}
@@ -0,0 +1,435 @@
+// Per-flow summary of RoCC trace captures
+//
+// Reads files written by `rocctop --record` (see rocctop.h for the format)
+// and prints, per flow: throughput, cwnd and pacing-rate percentiles, the
+// fraction of time spent in loss mode, decreases per second and the fraction
+// of app-limited samples. Several files are read as one capture, in the order
+// given, so rotated captures can be passed as is.
+//
+// Files are mmapped and the record array is split into one contiguous range
+// per thread. Each thread builds a partial summary of every flow it sees in
+// its range, with log-linear histograms for the percentiles. The partials are
+// then partitioned by flow hash across the same threads, each of which merges
+// its flows' partials in range order and computes their final summaries.
+// Everything mergeable is a sum except time in loss mode, which needs the
+// state at the end of the previous range; merging in order provides that.
+//
+// Time is attributed to the state of the flow's previous sample, so a flow's
+// duration runs from its first to its last sample. With sampled captures,
+// delivered bytes and decreases are scaled by the sampling rate.
+//
+// Usage:
+//   rocc_trace_analyze [options] FILE...
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "rocctop.h"
+
+namespace {
+
+enum class SortKey { kThroughput, kCwnd, kLossMode, kDecreases };
+
+struct Options {
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t top = 50;
+  SortKey sort = SortKey::kThroughput;
+};
+
+// Log-linear histogram: exact below 16, then 16 buckets per power of two
+// (under 7% error). Only the span of buckets in use is stored, which for a
+// single flow is usually a few octaves.
+class LogHist {
+ public:
+  void add(uint64_t v) {
+    const uint32_t b = bucket(v);
+    grow(b, b);
+    ++counts_[b - base_];
+  }
+
+  void merge(const LogHist& o) {
+    if (o.counts_.empty()) return;
+    grow(o.base_, o.base_ + static_cast<uint32_t>(o.counts_.size()) - 1);
+    for (size_t i = 0; i < o.counts_.size(); ++i) counts_[o.base_ - base_ + i] += o.counts_[i];
+  }
+
+  // Midpoint of the bucket holding quantile q
+  uint64_t quantile(double q) const {
+    uint64_t total = 0;
+    for (uint32_t c : counts_) total += c;
+    if (!total) return 0;
+    const uint64_t rank = static_cast<uint64_t>(q * (total - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      seen += counts_[i];
+      if (seen > rank) return midpoint(base_ + static_cast<uint32_t>(i));
+    }
+    return midpoint(base_ + static_cast<uint32_t>(counts_.size()) - 1);
+  }
+
+ private:
+  static uint32_t bucket(uint64_t v) {
+    if (v < 16) return static_cast<uint32_t>(v);
+    const uint32_t e = 63 - __builtin_clzll(v);
+    return (e - 3) * 16 + static_cast<uint32_t>((v >> (e - 4)) & 15);
+  }
+
+  static uint64_t midpoint(uint32_t b) {
+    if (b < 16) return b;
+    const uint32_t e = b / 16 + 3;
+    const uint64_t low = static_cast<uint64_t>(16 + b % 16) << (e - 4);
+    return low + ((uint64_t{1} << (e - 4)) >> 1);
+  }
+
+  void grow(uint32_t lo, uint32_t hi) {
+    if (counts_.empty()) {
+      base_ = lo;
+      counts_.assign(hi - lo + 1, 0);
+      return;
+    }
+    if (lo < base_) {
+      counts_.insert(counts_.begin(), base_ - lo, 0);
+      base_ = lo;
+    }
+    if (hi >= base_ + counts_.size()) counts_.resize(hi - base_ + 1, 0);
+  }
+
+  uint32_t base_ = 0;
+  std::vector<uint32_t> counts_;
+};
+
+// Socket addresses are reused once a socket is freed, so the ports are part of
+// the flow identity
+struct FlowKey {
+  uint64_t sk;
+  uint16_t sport;
+  uint16_t dport;
+
+  bool operator==(const FlowKey& o) const {
+    return sk == o.sk && sport == o.sport && dport == o.dport;
+  }
+};
+
+struct FlowKeyHash {
+  size_t operator()(const FlowKey& k) const {
+    uint64_t h = k.sk ^ (static_cast<uint64_t>(k.sport) << 48 | static_cast<uint64_t>(k.dport) << 32);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+  }
+};
+
+// One flow over one range of records
+struct Partial {
+  uint64_t first_ns = 0;
+  uint64_t last_ns = 0;
+  uint8_t last_flags = 0;
+  uint64_t samples = 0;
+  uint64_t app_limited = 0;
+  uint64_t decreases = 0;
+  uint64_t delivered_bytes = 0;
+  uint64_t loss_mode_ns = 0;
+  LogHist cwnd;
+  LogHist pacing;
+
+  void add(const rocc_sample_record& r) {
+    if (samples == 0) {
+      first_ns = r.time_ns;
+    } else if (r.time_ns > last_ns && (last_flags & ROCC_REC_LOSS_MODE)) {
+      loss_mode_ns += r.time_ns - last_ns;
+    }
+    last_ns = std::max<uint64_t>(last_ns, r.time_ns);
+    last_flags = r.flags;
+    ++samples;
+    app_limited += !!(r.flags & ROCC_REC_APP_LIMITED);
+    decreases += !!(r.flags & ROCC_REC_DECREASED);
+    delivered_bytes += static_cast<uint64_t>(r.acked) * r.mss;
+    cwnd.add(r.cwnd);
+    pacing.add(r.pacing_rate);
+  }
+
+  // `later` covers records after all of ours
+  void merge(const Partial& later) {
+    if (samples == 0) {
+      *this = later;
+      return;
+    }
+    if (later.first_ns > last_ns && (last_flags & ROCC_REC_LOSS_MODE))
+      loss_mode_ns += later.first_ns - last_ns;
+    last_ns = std::max(last_ns, later.last_ns);
+    last_flags = later.last_flags;
+    samples += later.samples;
+    app_limited += later.app_limited;
+    decreases += later.decreases;
+    delivered_bytes += later.delivered_bytes;
+    loss_mode_ns += later.loss_mode_ns;
+    cwnd.merge(later.cwnd);
+    pacing.merge(later.pacing);
+  }
+};
+
+using PartialMap = std::unordered_map<FlowKey, Partial, FlowKeyHash>;
+
+struct Summary {
+  FlowKey key;
+  double duration_s;
+  double mbps;
+  uint64_t cwnd_p10, cwnd_p50, cwnd_p99;
+  double pace_p50_mbps, pace_p99_mbps;
+  double loss_mode_frac;
+  double decreases_per_s;
+  double app_limited_frac;
+  uint64_t samples;
+};
+
+Summary summarise(const FlowKey& key, const Partial& p, uint32_t sample_every) {
+  Summary s;
+  s.key = key;
+  s.duration_s = (p.last_ns - p.first_ns) / 1e9;
+  const double dur = std::max(s.duration_s, 1e-9);
+  s.mbps = p.samples > 1 ? p.delivered_bytes * sample_every * 8 / dur / 1e6 : 0;
+  s.cwnd_p10 = p.cwnd.quantile(0.1);
+  s.cwnd_p50 = p.cwnd.quantile(0.5);
+  s.cwnd_p99 = p.cwnd.quantile(0.99);
+  s.pace_p50_mbps = p.pacing.quantile(0.5) * 8 / 1e6;
+  s.pace_p99_mbps = p.pacing.quantile(0.99) * 8 / 1e6;
+  s.loss_mode_frac = p.samples > 1 ? p.loss_mode_ns / 1e9 / dur : 0;
+  s.decreases_per_s = p.samples > 1 ? p.decreases * sample_every / dur : 0;
+  s.app_limited_frac = static_cast<double>(p.app_limited) / p.samples;
+  s.samples = p.samples;
+  return s;
+}
+
+// The mapped records of one file
+struct Span {
+  const rocc_sample_record* records;
+  size_t count;
+};
+
+class Capture {
+ public:
+  ~Capture() {
+    for (const auto& m : maps_) munmap(m.first, m.second);
+  }
+
+  bool open(const char* path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return fail(path, std::strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      return fail(path, std::strerror(errno));
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (size < sizeof(rocc_trace_header)) {
+      ::close(fd);
+      return fail(path, "too short for a trace header");
+    }
+    void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) return fail(path, std::strerror(errno));
+    maps_.emplace_back(base, size);
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    rocc_trace_header hdr;
+    std::memcpy(&hdr, base, sizeof(hdr));
+    if (std::memcmp(hdr.magic, ROCC_TRACE_MAGIC, sizeof(hdr.magic)) != 0)
+      return fail(path, "not a rocctop --record capture");
+    if (hdr.record_size != sizeof(rocc_sample_record))
+      return fail(path, "unsupported record size");
+    if (!spans_.empty() && hdr.sample_every != sample_every_)
+      return fail(path, "sampling rate differs from the previous files");
+    sample_every_ = std::max(1u, hdr.sample_every);
+
+    // A capture cut short may end in a partial record
+    const size_t bytes = size - sizeof(hdr);
+    if (bytes % sizeof(rocc_sample_record))
+      std::fprintf(stderr, "rocc_trace_analyze: %s: ignoring truncated last record\n", path);
+    const auto* records = reinterpret_cast<const rocc_sample_record*>(
+        static_cast<const char*>(base) + sizeof(hdr));
+    spans_.push_back(Span{records, bytes / sizeof(rocc_sample_record)});
+    total_ += spans_.back().count;
+    return true;
+  }
+
+  size_t size() const { return total_; }
+  uint32_t sample_every() const { return sample_every_; }
+
+  // Calls f on records [first, last) of the concatenated files
+  template <typename F>
+  void for_each(size_t first, size_t last, F&& f) const {
+    size_t offset = 0;
+    for (const Span& s : spans_) {
+      const size_t lo = std::max(first, offset), hi = std::min(last, offset + s.count);
+      for (size_t i = lo; i < hi; ++i) f(s.records[i - offset]);
+      offset += s.count;
+      if (offset >= last) break;
+    }
+  }
+
+ private:
+  static bool fail(const char* path, const char* why) {
+    std::fprintf(stderr, "rocc_trace_analyze: %s: %s\n", path, why);
+    return false;
+  }
+
+  std::vector<std::pair<void*, size_t>> maps_;
+  std::vector<Span> spans_;
+  size_t total_ = 0;
+  uint32_t sample_every_ = 1;
+};
+
+std::vector<Summary> analyse(const Capture& cap, unsigned threads) {
+  // Phase 1: a partial per flow per contiguous range
+  std::vector<PartialMap> ranges(threads);
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      const size_t first = cap.size() * t / threads, last = cap.size() * (t + 1) / threads;
+      PartialMap& flows = ranges[t];
+      // Consecutive records often belong to the same flow
+      FlowKey prev_key{0, 0, 0};
+      Partial* prev = nullptr;
+      cap.for_each(first, last, [&](const rocc_sample_record& r) {
+        const FlowKey key{r.key, r.sport, r.dport};
+        if (!prev || !(key == prev_key)) {
+          prev = &flows[key];
+          prev_key = key;
+        }
+        prev->add(r);
+      });
+    });
+  }
+  for (std::thread& t : pool) t.join();
+  pool.clear();
+
+  // Phase 2: each thread merges the flows that hash to it, in range order
+  std::vector<std::vector<Summary>> out(threads);
+  for (unsigned t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      PartialMap mine;
+      const FlowKeyHash hash;
+      for (const PartialMap& range : ranges) {
+        for (const auto& kv : range) {
+          if (hash(kv.first) % threads == t) mine[kv.first].merge(kv.second);
+        }
+      }
+      out[t].reserve(mine.size());
+      for (const auto& kv : mine) out[t].push_back(summarise(kv.first, kv.second, cap.sample_every()));
+    });
+  }
+  for (std::thread& t : pool) t.join();
+
+  std::vector<Summary> all;
+  for (auto& v : out) all.insert(all.end(), v.begin(), v.end());
+  return all;
+}
+
+double sort_value(const Summary& s, SortKey key) {
+  switch (key) {
+    case SortKey::kThroughput: return s.mbps;
+    case SortKey::kCwnd: return static_cast<double>(s.cwnd_p50);
+    case SortKey::kLossMode: return s.loss_mode_frac;
+    case SortKey::kDecreases: return s.decreases_per_s;
+  }
+  return 0;
+}
+
+void print_table(std::vector<Summary>& flows, const Options& opt) {
+  const SortKey key = opt.sort;
+  std::sort(flows.begin(), flows.end(), [key](const Summary& a, const Summary& b) {
+    return sort_value(a, key) > sort_value(b, key);
+  });
+  std::printf("%-30s %8s %9s %7s %7s %7s %9s %9s %7s %7s %7s %10s\n", "flow", "dur_s", "mbps",
+              "cwnd10", "cwnd50", "cwnd99", "pace50", "pace99", "lmode%", "dec/s", "applim%",
+              "samples");
+  for (size_t i = 0; i < flows.size() && (opt.top == 0 || i < opt.top); ++i) {
+    const Summary& s = flows[i];
+    char flow[64];
+    std::snprintf(flow, sizeof(flow), "%u>%u/%llx", s.key.sport, s.key.dport,
+                  static_cast<unsigned long long>(s.key.sk & 0xffffffff));
+    std::printf("%-30s %8.2f %9.2f %7llu %7llu %7llu %9.2f %9.2f %7.1f %7.2f %7.1f %10llu\n", flow,
+                s.duration_s, s.mbps, static_cast<unsigned long long>(s.cwnd_p10),
+                static_cast<unsigned long long>(s.cwnd_p50),
+                static_cast<unsigned long long>(s.cwnd_p99), s.pace_p50_mbps, s.pace_p99_mbps,
+                100 * s.loss_mode_frac, s.decreases_per_s, 100 * s.app_limited_frac,
+                static_cast<unsigned long long>(s.samples));
+  }
+}
+
+void usage(const char* prog) {
+  std::fprintf(stderr,
+               "Usage: %s [options] FILE...\n"
+               "  --threads=N  worker threads (default: all cores)\n"
+               "  --top=N      flows shown, 0 for all (default 50)\n"
+               "  --sort=KEY   tput, cwnd, lossmode or dec (default tput)\n"
+               "FILEs are rocctop --record captures, read as one capture in order.\n",
+               prog);
+}
+
+bool parse_opt(const char* arg, const char* name, std::string* value) {
+  size_t n = std::strlen(name);
+  if (std::strncmp(arg, name, n) != 0 || arg[n] != '=') return false;
+  *value = arg + n + 1;
+  return true;
+}
+
+bool parse_sort(const std::string& v, SortKey* key) {
+  if (v == "tput") *key = SortKey::kThroughput;
+  else if (v == "cwnd") *key = SortKey::kCwnd;
+  else if (v == "lossmode") *key = SortKey::kLossMode;
+  else if (v == "dec") *key = SortKey::kDecreases;
+  else return false;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; ++i) {
+    std::string v;
+    if (parse_opt(argv[i], "--threads", &v)) opt.threads = std::max(1ul, std::stoul(v));
+    else if (parse_opt(argv[i], "--top", &v)) opt.top = std::stoul(v);
+    else if (parse_opt(argv[i], "--sort", &v) && parse_sort(v, &opt.sort)) continue;
+    else if (argv[i][0] != '-') files.push_back(argv[i]);
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (files.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Capture cap;
+  for (const char* f : files) {
+    if (!cap.open(f)) return 1;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<Summary> flows = analyse(cap, opt.threads);
+  const double secs =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::printf("%zu records, %zu flows, sampling 1/%u, %u threads, %.3f s (%.1f M records/s)\n\n",
+              cap.size(), flows.size(), cap.sample_every(), opt.threads, secs,
+              cap.size() / secs / 1e6);
+  print_table(flows, opt);
+  return 0;
+}
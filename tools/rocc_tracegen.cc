@@ -0,0 +1,168 @@
+// Synthetic delivery-trace generator for cellular and wireless links
+//
+// Produces seeded, reproducible delivery-opportunity traces (see
+// delivery_trace.hpp) with:
+//   - capacity variability: the rate follows a log-normal random walk, changed
+//     every --change-ms and kept within [--min-mbps, --max-mbps]
+//   - outages: start as a Poisson process (--outages per second) and last an
+//     exponentially distributed time (--outage-ms mean)
+//   - ACK aggregation: opportunities are held back and released together at
+//     the end of every --aggregate-ms window
+//   - jitter: each opportunity is delayed by |N(0, --jitter-ms)|
+//
+// Usage:
+//   rocc_tracegen [options] OUTPUT
+//
+// With --count=N, writes N traces OUTPUT-000 ... with seeds seed, seed+1, ...
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "delivery_trace.hpp"
+
+namespace {
+
+// Bits carried by one delivery opportunity, as in Mahimahi
+constexpr double kOpportunityBits = 1504 * 8;
+
+struct Options {
+  uint64_t duration_ms = 60000;
+  double mbps = 24;
+  double min_mbps = 0.5;
+  double max_mbps = 200;
+  // Standard deviation of the log-rate change per step
+  double variability = 0.2;
+  uint64_t change_ms = 100;
+  double outages = 0;
+  double outage_ms = 500;
+  uint64_t aggregate_ms = 0;
+  double jitter_ms = 0;
+  uint64_t seed = 1;
+  int count = 1;
+  bool binary = false;
+};
+
+DeliveryTrace generate(const Options& opt, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::normal_distribution<double> step(0, opt.variability);
+  std::exponential_distribution<double> outage_gap(opt.outages > 0 ? opt.outages / 1000 : 1);
+  std::exponential_distribution<double> outage_len(1 / opt.outage_ms);
+  std::normal_distribution<double> jitter(0, opt.jitter_ms);
+
+  std::vector<uint64_t> ms;
+  double log_rate = std::log(opt.mbps);
+  double credit = 0;
+  double next_outage = opt.outages > 0 ? outage_gap(rng) : INFINITY;
+  double outage_end = -1;
+
+  for (uint64_t t = 0; t < opt.duration_ms; ++t) {
+    if (opt.variability > 0 && t % opt.change_ms == 0 && t > 0) {
+      log_rate = std::clamp(log_rate + step(rng), std::log(opt.min_mbps), std::log(opt.max_mbps));
+    }
+    if (t >= next_outage) {
+      outage_end = t + outage_len(rng);
+      next_outage = outage_end + outage_gap(rng);
+    }
+    if (t < outage_end) continue;
+
+    // Opportunities in this millisecond
+    credit += std::exp(log_rate) * 1000 / kOpportunityBits;
+    for (; credit >= 1; credit -= 1) {
+      double at = static_cast<double>(t);
+      if (opt.jitter_ms > 0) at += std::fabs(jitter(rng));
+      if (opt.aggregate_ms > 0) {
+        at = std::ceil((at + 1) / static_cast<double>(opt.aggregate_ms)) *
+             static_cast<double>(opt.aggregate_ms);
+      }
+      ms.push_back(static_cast<uint64_t>(at));
+    }
+  }
+  std::sort(ms.begin(), ms.end());
+  // Make the trace period cover the whole duration, even if it ends in an
+  // outage
+  if (ms.empty() || ms.back() < opt.duration_ms) ms.push_back(opt.duration_ms);
+  return DeliveryTrace(std::move(ms));
+}
+
+void usage(const char* prog) {
+  std::fprintf(stderr,
+               "Usage: %s [options] OUTPUT\n"
+               "  --duration-ms=N    trace length (default 60000)\n"
+               "  --mbps=R           initial/median rate (default 24)\n"
+               "  --min-mbps=R       lowest rate (default 0.5)\n"
+               "  --max-mbps=R       highest rate (default 200)\n"
+               "  --variability=S    std-dev of log-rate change per step, 0 = fixed (default 0.2)\n"
+               "  --change-ms=N      rate change interval (default 100)\n"
+               "  --outages=R        outages per second (default 0)\n"
+               "  --outage-ms=N      mean outage length (default 500)\n"
+               "  --aggregate-ms=N   release opportunities in bursts every N ms (default 0)\n"
+               "  --jitter-ms=S      std-dev of per-opportunity delay (default 0)\n"
+               "  --seed=N           random seed (default 1)\n"
+               "  --count=N          number of traces, seeds seed..seed+N-1 (default 1)\n"
+               "  --binary           write the compact binary format\n",
+               prog);
+}
+
+bool parse_opt(const char* arg, const char* name, std::string* value) {
+  size_t n = std::strlen(name);
+  if (std::strncmp(arg, name, n) != 0 || arg[n] != '=') return false;
+  *value = arg + n + 1;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  std::string output;
+  for (int i = 1; i < argc; ++i) {
+    std::string v;
+    if (parse_opt(argv[i], "--duration-ms", &v)) opt.duration_ms = std::stoull(v);
+    else if (parse_opt(argv[i], "--mbps", &v)) opt.mbps = std::stod(v);
+    else if (parse_opt(argv[i], "--min-mbps", &v)) opt.min_mbps = std::stod(v);
+    else if (parse_opt(argv[i], "--max-mbps", &v)) opt.max_mbps = std::stod(v);
+    else if (parse_opt(argv[i], "--variability", &v)) opt.variability = std::stod(v);
+    else if (parse_opt(argv[i], "--change-ms", &v)) opt.change_ms = std::max(1ULL, std::stoull(v));
+    else if (parse_opt(argv[i], "--outages", &v)) opt.outages = std::stod(v);
+    else if (parse_opt(argv[i], "--outage-ms", &v)) opt.outage_ms = std::stod(v);
+    else if (parse_opt(argv[i], "--aggregate-ms", &v)) opt.aggregate_ms = std::stoull(v);
+    else if (parse_opt(argv[i], "--jitter-ms", &v)) opt.jitter_ms = std::stod(v);
+    else if (parse_opt(argv[i], "--seed", &v)) opt.seed = std::stoull(v);
+    else if (parse_opt(argv[i], "--count", &v)) opt.count = std::stoi(v);
+    else if (std::strcmp(argv[i], "--binary") == 0) opt.binary = true;
+    else if (argv[i][0] == '-' || !output.empty()) {
+      usage(argv[0]);
+      return 1;
+    } else output = argv[i];
+  }
+  if (output.empty() || opt.duration_ms == 0 || opt.mbps <= 0 || opt.min_mbps <= 0 ||
+      opt.min_mbps > opt.max_mbps || opt.count < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  opt.mbps = std::clamp(opt.mbps, opt.min_mbps, opt.max_mbps);
+
+  try {
+    for (int i = 0; i < opt.count; ++i) {
+      std::string path = output;
+      if (opt.count > 1) {
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), "-%03d", i);
+        path += suffix;
+      }
+      DeliveryTrace trace = generate(opt, opt.seed + i);
+      if (opt.binary) trace.save_binary(path);
+      else trace.save(path);
+    }
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "rocc_tracegen: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
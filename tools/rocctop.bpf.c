@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// Kernel side of rocctop. Samples the tcp_rocc:rocc_sample tracepoint,
+// aggregates per flow and sends one summary per flow per interval to
+// userspace through a ring buffer. In record mode every sampled ACK is sent
+// as is through a second ring buffer instead.
+
+#include "vmlinux.h"
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_endian.h>
+#include <bpf/bpf_helpers.h>
+
+#include "rocctop.h"
+
+#define AF_INET 2
+
+// Set by userspace before loading
+const volatile __u32 sample_every = 1;
+const volatile __u64 interval_ns = 1000000000;
+const volatile bool record = false;
+
+// Records lost to a full ring buffer in record mode
+__u64 dropped = 0;
+
+// Interval in progress, per flow. LRU, so closed flows age out.
+struct {
+	__uint(type, BPF_MAP_TYPE_LRU_HASH);
+	__uint(max_entries, 65536);
+	__type(key, __u64);
+	__type(value, struct rocc_flow_summary);
+} flows SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_RINGBUF);
+	__uint(max_entries, 1 << 22);
+} summaries SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_RINGBUF);
+	__uint(max_entries, 1 << 26);
+} samples SEC(".maps");
+
+static void init_flow(struct rocc_flow_summary *f, struct sock *sk, __u64 now)
+{
+	__u32 saddr, daddr;
+
+	f->key = (__u64) sk;
+	f->start_ns = now;
+	f->sport = BPF_CORE_READ(sk, __sk_common.skc_num);
+	f->dport = bpf_ntohs(BPF_CORE_READ(sk, __sk_common.skc_dport));
+	if (BPF_CORE_READ(sk, __sk_common.skc_family) == AF_INET) {
+		saddr = BPF_CORE_READ(sk, __sk_common.skc_rcv_saddr);
+		daddr = BPF_CORE_READ(sk, __sk_common.skc_daddr);
+		f->saddr[10] = f->saddr[11] = 0xff;
+		f->daddr[10] = f->daddr[11] = 0xff;
+		__builtin_memcpy(&f->saddr[12], &saddr, 4);
+		__builtin_memcpy(&f->daddr[12], &daddr, 4);
+	} else {
+		BPF_CORE_READ_INTO(&f->saddr, sk, __sk_common.skc_v6_rcv_saddr.in6_u.u6_addr8);
+		BPF_CORE_READ_INTO(&f->daddr, sk, __sk_common.skc_v6_daddr.in6_u.u6_addr8);
+	}
+}
+
+static void record_sample(struct bpf_raw_tracepoint_args *ctx, struct sock *sk, __u64 now)
+{
+	struct rocc_sample_record *r;
+
+	r = bpf_ringbuf_reserve(&samples, sizeof(*r), 0);
+	if (!r) {
+		__sync_fetch_and_add(&dropped, 1);
+		return;
+	}
+	r->time_ns = now;
+	r->key = (__u64) sk;
+	r->pacing_rate = ctx->args[2];
+	r->cwnd = ctx->args[1];
+	r->min_rtt_us = ctx->args[3];
+	r->acked = ctx->args[4];
+	r->lost = ctx->args[5];
+	r->sport = BPF_CORE_READ(sk, __sk_common.skc_num);
+	r->dport = bpf_ntohs(BPF_CORE_READ(sk, __sk_common.skc_dport));
+	r->mss = BPF_CORE_READ((struct tcp_sock *) sk, mss_cache);
+	r->flags = (ctx->args[6] ? ROCC_REC_LOSS_MODE : 0) |
+		   (ctx->args[7] ? ROCC_REC_APP_LIMITED : 0) |
+		   (ctx->args[8] ? ROCC_REC_DECREASED : 0);
+	r->pad = 0;
+	bpf_ringbuf_submit(r, 0);
+}
+
+// Arguments are those of TP_PROTO in tcp_rocc_trace.h
+SEC("raw_tp/rocc_sample")
+int on_rocc_sample(struct bpf_raw_tracepoint_args *ctx)
+{
+	struct sock *sk = (struct sock *) ctx->args[0];
+	struct rocc_flow_summary *f, *out;
+	struct rocc_flow_summary init = {};
+	__u64 key = (__u64) sk;
+	__u64 now;
+
+	if (sample_every > 1 && bpf_get_prandom_u32() % sample_every)
+		return 0;
+	now = bpf_ktime_get_ns();
+	if (record) {
+		record_sample(ctx, sk, now);
+		return 0;
+	}
+	f = bpf_map_lookup_elem(&flows, &key);
+	if (!f) {
+		init_flow(&init, sk, now);
+		bpf_map_update_elem(&flows, &key, &init, BPF_NOEXIST);
+		f = bpf_map_lookup_elem(&flows, &key);
+		if (!f)
+			return 0;
+	}
+	// ACKs of one socket are processed under its lock, so plain updates
+	// are enough
+	f->cwnd = ctx->args[1];
+	f->pacing_rate = ctx->args[2];
+	f->min_rtt_us = ctx->args[3];
+	f->acked += (__u32) ctx->args[4];
+	f->lost += (__u32) ctx->args[5];
+	f->loss_mode_samples += !!ctx->args[6];
+	f->app_limited_samples += !!ctx->args[7];
+	++f->samples;
+	if (now - f->start_ns < interval_ns)
+		return 0;
+
+	f->end_ns = now;
+	out = bpf_ringbuf_reserve(&summaries, sizeof(*out), 0);
+	if (out) {
+		__builtin_memcpy(out, f, sizeof(*out));
+		bpf_ringbuf_submit(out, 0);
+	}
+	f->start_ns = now;
+	f->samples = 0;
+	f->loss_mode_samples = 0;
+	f->app_limited_samples = 0;
+	f->acked = 0;
+	f->lost = 0;
+	return 0;
+}
+
+char LICENSE[] SEC("license") = "GPL";
@@ -0,0 +1,296 @@
+// rocctop: live per-flow view of RoCC
+//
+// Attaches rocctop.bpf.c to the module's rocc_sample tracepoint. The BPF side
+// samples ACKs (--sample=N keeps one in N) and aggregates them per flow in the
+// kernel; once per --interval-ms each active flow sends one summary through a
+// BPF ring buffer. The screen shows the top flows by --sort, refreshed every
+// interval. With --batch, summaries are printed as they arrive instead.
+//
+// With --record=FILE nothing is aggregated: every sampled ACK is appended to
+// FILE as a rocc_sample_record (see rocctop.h) until interrupted. A new FILE
+// starts with a header; an existing one must have been recorded with the same
+// --sample. Such captures are read by rocc_trace_analyze.
+//
+// Needs root (or CAP_BPF and CAP_PERFMON), the module loaded, and a kernel
+// with BTF. Build with `make rocctop` (needs clang, bpftool and libbpf).
+//
+// Usage:
+//   rocctop [options]
+
+#include <arpa/inet.h>
+#include <bpf/libbpf.h>
+#include <signal.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rocctop.h"
+#include "rocctop.skel.h"
+
+namespace {
+
+enum class SortKey { kCwnd, kPacing, kLoss, kLossMode };
+
+struct Options {
+  uint32_t sample_every = 1;
+  uint64_t interval_ms = 1000;
+  SortKey sort = SortKey::kCwnd;
+  size_t top = 20;
+  bool batch = false;
+  std::string record;
+};
+
+struct Flow {
+  rocc_flow_summary last;
+  // Monotonic time of the last summary, in ns
+  uint64_t seen_ns;
+};
+
+volatile sig_atomic_t g_stop = 0;
+
+uint64_t now_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+std::string endpoint(const uint8_t* addr, uint16_t port) {
+  static const uint8_t kMapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+  char buf[INET6_ADDRSTRLEN];
+  if (std::memcmp(addr, kMapped, sizeof(kMapped)) == 0) {
+    inet_ntop(AF_INET, addr + 12, buf, sizeof(buf));
+    return std::string(buf) + ":" + std::to_string(port);
+  }
+  inet_ntop(AF_INET6, addr, buf, sizeof(buf));
+  return "[" + std::string(buf) + "]:" + std::to_string(port);
+}
+
+double loss_rate(const rocc_flow_summary& s) {
+  const uint64_t total = s.acked + s.lost;
+  return total ? static_cast<double>(s.lost) / total : 0;
+}
+
+double fraction(uint32_t n, uint32_t samples) {
+  return samples ? static_cast<double>(n) / samples : 0;
+}
+
+double sort_value(const rocc_flow_summary& s, SortKey key) {
+  switch (key) {
+    case SortKey::kCwnd: return s.cwnd;
+    case SortKey::kPacing: return static_cast<double>(s.pacing_rate);
+    case SortKey::kLoss: return loss_rate(s);
+    case SortKey::kLossMode: return fraction(s.loss_mode_samples, s.samples);
+  }
+  return 0;
+}
+
+void print_header() {
+  std::printf("%-46s %8s %10s %9s %7s %7s %7s %8s\n", "flow", "cwnd", "pace_mbps",
+              "minrtt_ms", "loss%", "lmode%", "applim%", "samples");
+}
+
+void print_flow(const rocc_flow_summary& s) {
+  const std::string flow = endpoint(s.saddr, s.sport) + " > " + endpoint(s.daddr, s.dport);
+  std::printf("%-46s %8u %10.2f %9.3f %7.2f %7.1f %7.1f %8u\n", flow.c_str(), s.cwnd,
+              s.pacing_rate * 8 / 1e6, s.min_rtt_us / 1e3, 100 * loss_rate(s),
+              100 * fraction(s.loss_mode_samples, s.samples),
+              100 * fraction(s.app_limited_samples, s.samples), s.samples);
+}
+
+struct Monitor {
+  Options opt;
+  std::unordered_map<uint64_t, Flow> flows;
+  FILE* out = nullptr;
+  uint64_t recorded = 0;
+
+  static int on_record(void* ctx, void* data, size_t size) {
+    auto* self = static_cast<Monitor*>(ctx);
+    if (size < sizeof(rocc_sample_record)) return 0;
+    if (std::fwrite(data, sizeof(rocc_sample_record), 1, self->out) != 1) return -EIO;
+    ++self->recorded;
+    return 0;
+  }
+
+  static int on_summary(void* ctx, void* data, size_t size) {
+    auto* self = static_cast<Monitor*>(ctx);
+    if (size < sizeof(rocc_flow_summary)) return 0;
+    const auto* s = static_cast<const rocc_flow_summary*>(data);
+    if (self->opt.batch) {
+      print_flow(*s);
+      std::fflush(stdout);
+    } else {
+      self->flows[s->key] = Flow{*s, now_ns()};
+    }
+    return 0;
+  }
+
+  void draw() {
+    // Flows that sent nothing for three intervals have gone idle or closed
+    const uint64_t now = now_ns();
+    const uint64_t expiry = 3 * opt.interval_ms * 1000000;
+    std::vector<const rocc_flow_summary*> live;
+    for (auto it = flows.begin(); it != flows.end();) {
+      if (now - it->second.seen_ns > expiry) {
+        it = flows.erase(it);
+      } else {
+        live.push_back(&it->second.last);
+        ++it;
+      }
+    }
+    const SortKey key = opt.sort;
+    std::sort(live.begin(), live.end(), [key](const auto* a, const auto* b) {
+      return sort_value(*a, key) > sort_value(*b, key);
+    });
+
+    double total_mbps = 0;
+    for (const auto* s : live) total_mbps += s->pacing_rate * 8 / 1e6;
+    std::printf("\033[H\033[2J");
+    std::printf("rocctop - %zu flows, total pacing %.1f Mbit/s, sampling 1/%u, interval %llu ms\n\n",
+                live.size(), total_mbps, opt.sample_every,
+                static_cast<unsigned long long>(opt.interval_ms));
+    print_header();
+    for (size_t i = 0; i < live.size() && i < opt.top; ++i) print_flow(*live[i]);
+    std::fflush(stdout);
+  }
+};
+
+void usage(const char* prog) {
+  std::fprintf(stderr,
+               "Usage: %s [options]\n"
+               "  --sample=N         aggregate one in N ACKs (default 1)\n"
+               "  --interval-ms=N    aggregation and refresh interval (default 1000)\n"
+               "  --sort=KEY         cwnd, pacing, loss or lossmode (default cwnd)\n"
+               "  --top=N            flows shown (default 20)\n"
+               "  --batch            print each summary as it arrives\n"
+               "  --record=FILE      append every sampled ACK to FILE instead\n",
+               prog);
+}
+
+bool parse_opt(const char* arg, const char* name, std::string* value) {
+  size_t n = std::strlen(name);
+  if (std::strncmp(arg, name, n) != 0 || arg[n] != '=') return false;
+  *value = arg + n + 1;
+  return true;
+}
+
+bool parse_sort(const std::string& v, SortKey* key) {
+  if (v == "cwnd") *key = SortKey::kCwnd;
+  else if (v == "pacing") *key = SortKey::kPacing;
+  else if (v == "loss") *key = SortKey::kLoss;
+  else if (v == "lossmode") *key = SortKey::kLossMode;
+  else return false;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Monitor mon;
+  Options& opt = mon.opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string v;
+    if (parse_opt(argv[i], "--sample", &v)) opt.sample_every = std::max(1UL, std::stoul(v));
+    else if (parse_opt(argv[i], "--interval-ms", &v)) opt.interval_ms = std::max(1ULL, std::stoull(v));
+    else if (parse_opt(argv[i], "--top", &v)) opt.top = std::stoul(v);
+    else if (parse_opt(argv[i], "--sort", &v) && parse_sort(v, &opt.sort)) continue;
+    else if (parse_opt(argv[i], "--record", &v) && !v.empty()) opt.record = v;
+    else if (std::strcmp(argv[i], "--batch") == 0) opt.batch = true;
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  rocctop_bpf* skel = rocctop_bpf__open();
+  if (!skel) {
+    std::fprintf(stderr, "rocctop: cannot open BPF object\n");
+    return 1;
+  }
+  skel->rodata->sample_every = opt.sample_every;
+  skel->rodata->interval_ns = opt.interval_ms * 1000000;
+  skel->rodata->record = !opt.record.empty();
+  int err = rocctop_bpf__load(skel);
+  if (!err) err = rocctop_bpf__attach(skel);
+  if (err) {
+    std::fprintf(stderr, "rocctop: cannot load or attach (is tcp_rocc_ccmatic loaded?): %s\n",
+                 std::strerror(-err));
+    rocctop_bpf__destroy(skel);
+    return 1;
+  }
+  ring_buffer* rb;
+  if (opt.record.empty()) {
+    rb = ring_buffer__new(bpf_map__fd(skel->maps.summaries), Monitor::on_summary, &mon, nullptr);
+  } else {
+    mon.out = std::fopen(opt.record.c_str(), "a+b");
+    if (!mon.out) {
+      std::fprintf(stderr, "rocctop: %s: %s\n", opt.record.c_str(), std::strerror(errno));
+      rocctop_bpf__destroy(skel);
+      return 1;
+    }
+    std::setvbuf(mon.out, nullptr, _IOFBF, 1 << 22);
+    rocc_trace_header hdr = {};
+    std::memcpy(hdr.magic, ROCC_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.record_size = sizeof(rocc_sample_record);
+    hdr.sample_every = opt.sample_every;
+    // Appending to an earlier capture: its header must describe ours too
+    std::fseek(mon.out, 0, SEEK_END);
+    if (std::ftell(mon.out) > 0) {
+      rocc_trace_header old;
+      std::rewind(mon.out);
+      if (std::fread(&old, sizeof(old), 1, mon.out) != 1 ||
+          std::memcmp(&old, &hdr, sizeof(hdr)) != 0) {
+        std::fprintf(stderr, "rocctop: %s is not a capture with the same --sample\n",
+                     opt.record.c_str());
+        std::fclose(mon.out);
+        rocctop_bpf__destroy(skel);
+        return 1;
+      }
+      // A read must be followed by a seek before writing
+      std::fseek(mon.out, 0, SEEK_END);
+    } else {
+      std::fwrite(&hdr, sizeof(hdr), 1, mon.out);
+    }
+    rb = ring_buffer__new(bpf_map__fd(skel->maps.samples), Monitor::on_record, &mon, nullptr);
+  }
+  if (!rb) {
+    std::fprintf(stderr, "rocctop: cannot create ring buffer\n");
+    rocctop_bpf__destroy(skel);
+    return 1;
+  }
+
+  signal(SIGINT, [](int) { g_stop = 1; });
+  signal(SIGTERM, [](int) { g_stop = 1; });
+  if (opt.batch && !mon.out) print_header();
+  uint64_t next_draw = now_ns();
+  while (!g_stop) {
+    err = ring_buffer__poll(rb, 100);
+    if (err < 0 && err != -EINTR) {
+      std::fprintf(stderr, "rocctop: ring buffer: %s\n", std::strerror(-err));
+      break;
+    }
+    if (!opt.batch && !mon.out && now_ns() >= next_draw) {
+      mon.draw();
+      next_draw += opt.interval_ms * 1000000;
+    }
+  }
+  ring_buffer__free(rb);
+  int ret = 0;
+  if (mon.out) {
+    if (std::fclose(mon.out) != 0 || err == -EIO) {
+      std::fprintf(stderr, "rocctop: cannot write %s\n", opt.record.c_str());
+      ret = 1;
+    }
+    std::fprintf(stderr, "rocctop: recorded %llu samples, %llu dropped\n",
+                 static_cast<unsigned long long>(mon.recorded),
+                 static_cast<unsigned long long>(skel->bss->dropped));
+  }
+  rocctop_bpf__destroy(skel);
+  return ret;
+}
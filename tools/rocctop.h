@@ -0,0 +1,68 @@
+/* Records shared by rocctop.bpf.c, rocctop.cc and rocc_trace_analyze.cc */
+
+#ifndef _ROCCTOP_H
+#define _ROCCTOP_H
+
+#ifndef __VMLINUX_H__
+#include <linux/types.h>
+#endif
+
+// One flow over one aggregation interval
+struct rocc_flow_summary {
+	// Socket address, identifies the flow
+	__u64 key;
+	__u64 start_ns;
+	__u64 end_ns;
+	// Last pacing rate (bytes/s), cwnd and min RTT seen in the interval
+	__u64 pacing_rate;
+	__u32 cwnd;
+	__u32 min_rtt_us;
+	// Addresses, IPv4-mapped for AF_INET, and host-order ports
+	__u8 saddr[16];
+	__u8 daddr[16];
+	__u16 sport;
+	__u16 dport;
+	// Sampled ACKs, and how many of them were in loss mode or app-limited
+	__u32 samples;
+	__u32 loss_mode_samples;
+	__u32 app_limited_samples;
+	// Packets delivered and lost over the sampled ACKs
+	__u64 acked;
+	__u64 lost;
+};
+
+// Trace files written by `rocctop --record` start with this header, followed
+// by back-to-back rocc_sample_records in the order they were produced
+#define ROCC_TRACE_MAGIC "ROCCTRC1"
+
+struct rocc_trace_header {
+	char magic[8];
+	__u32 record_size;
+	// rocctop --sample: one in this many ACKs was recorded
+	__u32 sample_every;
+};
+
+#define ROCC_REC_LOSS_MODE 0x1
+#define ROCC_REC_APP_LIMITED 0x2
+#define ROCC_REC_DECREASED 0x4
+
+// One rocc_sample tracepoint hit
+struct rocc_sample_record {
+	__u64 time_ns;
+	// Socket address; with the ports, identifies the flow
+	__u64 key;
+	__u64 pacing_rate;
+	__u32 cwnd;
+	__u32 min_rtt_us;
+	// Packets delivered and lost by this ACK
+	__u32 acked;
+	__u32 lost;
+	__u16 sport;
+	__u16 dport;
+	__u16 mss;
+	// ROCC_REC_*
+	__u8 flags;
+	__u8 pad;
+};
+
+#endif /* _ROCCTOP_H */